@@ -0,0 +1,340 @@
+#pragma once
+
+#include "chess.hpp"
+
+namespace Chess
+{
+
+/********************
+ * Structure of arrays movegen for many unrelated positions.
+ * A BoardBatch holds up to BATCH_LANES positions, the masks of the movegen
+ * (checkmask, pins, seen squares) are computed for all of them at once with
+ * one vector instruction per step, 8 lanes with AVX-512 and 4 with AVX2.
+ * The moves themselves are generated per lane by the scalar movegen,
+ * which finds the masks already in place and skips its own init.
+ *******************/
+#if defined(__AVX512F__)
+static constexpr int BATCH_LANES = 8;
+#else
+static constexpr int BATCH_LANES = 4;
+#endif
+
+// GCC/Clang vector extensions, compiled to AVX2/AVX-512 and to scalar code without them
+typedef uint64_t BatchVec __attribute__((vector_size(BATCH_LANES * 8)));
+typedef int64_t BatchMask __attribute__((vector_size(BATCH_LANES * 8)));
+
+namespace Batch
+{
+
+static constexpr U64 NOT_A = ~MASK_FILE[FILE_A];
+static constexpr U64 NOT_AB = ~(MASK_FILE[FILE_A] | MASK_FILE[FILE_B]);
+static constexpr U64 NOT_H = ~MASK_FILE[FILE_H];
+static constexpr U64 NOT_GH = ~(MASK_FILE[FILE_G] | MASK_FILE[FILE_H]);
+
+/// @brief lanes where mask is set take a, the others take b
+inline BatchVec select(BatchMask mask, BatchVec a, BatchVec b)
+{
+    return ((BatchVec)mask & a) | (~(BatchVec)mask & b);
+}
+
+/// @brief bitboards moved by one step, squares that wrap around the a/h file are dropped
+template <Direction d> inline BatchVec step(BatchVec b)
+{
+    switch (d)
+    {
+    case NORTH:
+        return b << 8;
+    case SOUTH:
+        return b >> 8;
+    case EAST:
+        return (b << 1) & NOT_A;
+    case WEST:
+        return (b >> 1) & NOT_H;
+    case NORTH_EAST:
+        return (b << 9) & NOT_A;
+    case NORTH_WEST:
+        return (b << 7) & NOT_H;
+    case SOUTH_EAST:
+        return (b >> 7) & NOT_A;
+    case SOUTH_WEST:
+        return (b >> 9) & NOT_H;
+    }
+}
+
+/********************
+ * Kogge-Stone occluded fill in one direction, returns the attacked squares.
+ * gen spreads over the empty squares in 3 steps, the final step adds the blocker.
+ * The wrap mask is applied to the empty squares once, the doubled shifts
+ * then can not cross the a/h file anymore.
+ *******************/
+template <Direction d> inline BatchVec attacks(BatchVec gen, BatchVec empty)
+{
+    constexpr int s = d > 0 ? d : -d;
+    constexpr U64 wrap = d == EAST || d == NORTH_EAST || d == SOUTH_EAST   ? NOT_A
+                         : d == WEST || d == NORTH_WEST || d == SOUTH_WEST ? NOT_H
+                                                                           : ~0ULL;
+
+    BatchVec pro = empty & wrap;
+    if (d > 0)
+    {
+        gen |= pro & (gen << s);
+        pro &= pro << s;
+        gen |= pro & (gen << 2 * s);
+        pro &= pro << 2 * s;
+        gen |= pro & (gen << 4 * s);
+    }
+    else
+    {
+        gen |= pro & (gen >> s);
+        pro &= pro >> s;
+        gen |= pro & (gen >> 2 * s);
+        pro &= pro >> 2 * s;
+        gen |= pro & (gen >> 4 * s);
+    }
+
+    return step<d>(gen);
+}
+
+inline BatchVec knightAttacks(BatchVec b)
+{
+    return ((b << 17) & NOT_A) | ((b << 15) & NOT_H) | ((b << 10) & NOT_AB) | ((b << 6) & NOT_GH) |
+           ((b >> 17) & NOT_H) | ((b >> 15) & NOT_A) | ((b >> 10) & NOT_GH) | ((b >> 6) & NOT_AB);
+}
+
+inline BatchVec kingAttacks(BatchVec b)
+{
+    return step<NORTH>(b) | step<SOUTH>(b) | step<EAST>(b) | step<WEST>(b) | step<NORTH_EAST>(b) |
+           step<NORTH_WEST>(b) | step<SOUTH_EAST>(b) | step<SOUTH_WEST>(b);
+}
+
+/// @brief attacks of white pawns where white is set, of black pawns otherwise
+inline BatchVec pawnAttacks(BatchVec pawns, BatchMask white)
+{
+    return select(white, step<NORTH_EAST>(pawns) | step<NORTH_WEST>(pawns),
+                  step<SOUTH_EAST>(pawns) | step<SOUTH_WEST>(pawns));
+}
+
+/// @brief lanes with exactly one bit set
+inline BatchMask single(BatchVec b)
+{
+    return (b != 0) & ((b & (b - 1)) == 0);
+}
+
+} // namespace Batch
+
+class BoardBatch;
+
+/********************
+ * One lane of a BoardBatch, seen through the interface the movegen expects.
+ * The masks are copied out of the batch, movegenValid tells init that
+ * they are already computed.
+ *******************/
+struct BatchLane
+{
+    const BoardBatch &batch;
+    const int lane;
+
+    const uint8_t &castlingRights;
+    const Square &enPassantSquare;
+
+    uint8_t doubleCheck;
+    U64 pinHV;
+    U64 pinD;
+    U64 checkMask;
+    U64 seen;
+
+    U64 occEnemy = 0;
+    U64 occUs = 0;
+    U64 occAll = 0;
+    U64 enemyEmptyBB = 0;
+
+    static constexpr bool movegenCacheEnabled = true;
+    bool movegenValid = true;
+
+    BatchLane(const BoardBatch &batch, int lane);
+
+    U64 pieces(PieceType p, Color c) const;
+
+    U64 Us(Color c) const
+    {
+        return pieces(PAWN, c) | pieces(KNIGHT, c) | pieces(BISHOP, c) | pieces(ROOK, c) | pieces(QUEEN, c) |
+               pieces(KING, c);
+    }
+
+    Square KingSQ(Color c) const
+    {
+        return lsb(pieces(KING, c));
+    }
+};
+
+class BoardBatch
+{
+  public:
+    static constexpr int LANES = BATCH_LANES;
+
+    BatchVec piecesBB[12] = {};
+    Color sideToMove[LANES] = {};
+    Square enPassantSquare[LANES] = {};
+    uint8_t castlingRights[LANES] = {};
+
+    // movegen masks of every lane, filled by init()
+    BatchVec pinHV = {};
+    BatchVec pinD = {};
+    BatchVec checkMask = {};
+    BatchVec seen = {};
+    uint8_t doubleCheck[LANES] = {};
+
+    int size() const
+    {
+        return count;
+    }
+
+    bool full() const
+    {
+        return count == LANES;
+    }
+
+    void clear()
+    {
+        count = 0;
+        for (auto &bb : piecesBB)
+            bb = BatchVec{};
+    }
+
+    /// @brief adds a Board or a Position as the next lane
+    /// @return false when the batch is full
+    template <typename B> bool add(const B &board)
+    {
+        if (full())
+            return false;
+
+        for (int p = 0; p < 12; p++)
+            piecesBB[p][count] = board.pieces(PieceType(p % 6), Color(p / 6));
+
+        sideToMove[count] = board.sideToMove;
+        enPassantSquare[count] = board.enPassantSquare;
+        castlingRights[count] = board.castlingRights;
+        count++;
+        return true;
+    }
+
+    /// @brief computes the movegen masks of all lanes at once
+    void init();
+
+    /// @brief the moves of one lane, init() has to be called first
+    template <Movetype mt> void legalmoves(int lane, Movelist &movelist) const
+    {
+        BatchLane board(*this, lane);
+
+        movelist.size = 0;
+        if (sideToMove[lane] == White)
+            Movegen::legalmoves<White, mt>(board, movelist);
+        else
+            Movegen::legalmoves<Black, mt>(board, movelist);
+    }
+
+    /// @brief the number of moves of one lane, init() has to be called first
+    template <Movetype mt> int countLegalMoves(int lane) const
+    {
+        BatchLane board(*this, lane);
+
+        if (sideToMove[lane] == White)
+            return Movegen::countLegalMoves<White, mt>(board);
+        else
+            return Movegen::countLegalMoves<Black, mt>(board);
+    }
+
+  private:
+    int count = 0;
+};
+
+inline BatchLane::BatchLane(const BoardBatch &batch, int lane)
+    : batch(batch), lane(lane), castlingRights(batch.castlingRights[lane]),
+      enPassantSquare(batch.enPassantSquare[lane]), doubleCheck(batch.doubleCheck[lane]), pinHV(batch.pinHV[lane]),
+      pinD(batch.pinD[lane]), checkMask(batch.checkMask[lane]), seen(batch.seen[lane])
+{
+}
+
+inline U64 BatchLane::pieces(PieceType p, Color c) const
+{
+    return batch.piecesBB[p + c * 6][lane];
+}
+
+/********************
+ * The same masks as Movegen::init, for every lane at once.
+ * Lanes can have different sides to move, so every piece set is picked
+ * per lane with a mask of the lanes where white is to move.
+ * Sliders are handled per direction: the fill from our king towards
+ * an enemy slider is the check path, with only enemy pieces blocking
+ * it is the pin path when exactly one of our pieces is on it.
+ *******************/
+inline void BoardBatch::init()
+{
+    using namespace Batch;
+
+    BatchMask white = {};
+    for (int lane = 0; lane < LANES; lane++)
+        white[lane] = lane < count && sideToMove[lane] == White ? -1 : 0;
+
+    auto ours = [&](PieceType pt) { return select(white, piecesBB[pt], piecesBB[pt + 6]); };
+    auto theirs = [&](PieceType pt) { return select(white, piecesBB[pt + 6], piecesBB[pt]); };
+
+    BatchVec occUs = {}, occEnemy = {};
+    for (int pt = PAWN; pt <= KING; pt++)
+    {
+        occUs |= ours(PieceType(pt));
+        occEnemy |= theirs(PieceType(pt));
+    }
+
+    const BatchVec occAll = occUs | occEnemy;
+    const BatchVec king = ours(KING);
+    const BatchVec enemyQueens = theirs(QUEEN);
+    const BatchVec enemyRooks = theirs(ROOK) | enemyQueens;
+    const BatchVec enemyBishops = theirs(BISHOP) | enemyQueens;
+
+    // enemy attacks, our king does not block them
+    const BatchVec empty = ~(occAll ^ king);
+    seen = pawnAttacks(theirs(PAWN), ~white) | knightAttacks(theirs(KNIGHT)) | kingAttacks(theirs(KING)) |
+           attacks<NORTH>(enemyRooks, empty) | attacks<SOUTH>(enemyRooks, empty) |
+           attacks<EAST>(enemyRooks, empty) | attacks<WEST>(enemyRooks, empty) |
+           attacks<NORTH_EAST>(enemyBishops, empty) | attacks<NORTH_WEST>(enemyBishops, empty) |
+           attacks<SOUTH_EAST>(enemyBishops, empty) | attacks<SOUTH_WEST>(enemyBishops, empty);
+
+    const BatchVec pawnChecks = pawnAttacks(king, white) & theirs(PAWN);
+    const BatchVec knightChecks = knightAttacks(king) & theirs(KNIGHT);
+
+    BatchVec checks = pawnChecks | knightChecks;
+    BatchMask checkers = -(BatchMask)(pawnChecks != 0) - (BatchMask)(knightChecks != 0);
+
+    pinHV = BatchVec{};
+    pinD = BatchVec{};
+
+    auto slider = [&](auto direction, BatchVec sliders, BatchVec &pins) {
+        constexpr Direction d = decltype(direction)::value;
+
+        const BatchVec path = attacks<d>(king, ~occAll);
+        const BatchMask check = (path & sliders) != 0;
+        checks |= (BatchVec)check & path;
+        checkers -= check;
+
+        const BatchVec xray = attacks<d>(king, ~occEnemy);
+        const BatchMask pin = ((xray & sliders) != 0) & single(xray & occUs);
+        pins |= (BatchVec)pin & xray;
+    };
+
+    slider(std::integral_constant<Direction, NORTH>{}, enemyRooks, pinHV);
+    slider(std::integral_constant<Direction, SOUTH>{}, enemyRooks, pinHV);
+    slider(std::integral_constant<Direction, EAST>{}, enemyRooks, pinHV);
+    slider(std::integral_constant<Direction, WEST>{}, enemyRooks, pinHV);
+    slider(std::integral_constant<Direction, NORTH_EAST>{}, enemyBishops, pinD);
+    slider(std::integral_constant<Direction, NORTH_WEST>{}, enemyBishops, pinD);
+    slider(std::integral_constant<Direction, SOUTH_EAST>{}, enemyBishops, pinD);
+    slider(std::integral_constant<Direction, SOUTH_WEST>{}, enemyBishops, pinD);
+
+    checkMask = select(checks != 0, checks, BatchVec{} + DEFAULT_CHECKMASK);
+
+    for (int lane = 0; lane < LANES; lane++)
+        doubleCheck[lane] = uint8_t(std::min<int64_t>(checkers[lane], 2));
+}
+
+} // namespace Chess
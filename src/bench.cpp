@@ -0,0 +1,343 @@
+#include "chess.hpp"
+#include "tt.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+using namespace Chess;
+
+/********************
+ * Microbenchmarks of the primitives the movegen and search are built from.
+ * Every benchmark runs over the same set of positions, a few warmup runs
+ * are followed by repeated trials and the ns per operation are reported
+ * as median and percentiles of the trials.
+ *
+ * Usage:
+ * bench              all benchmarks
+ * bench name         only the benchmarks whose name contains name
+ * bench name trials  with a different number of trials, default 21
+ *******************/
+
+static const char *ROOTS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+
+// positions in the set, every n-th position up to 3 plies below the roots
+static constexpr int POSITIONS = 1024;
+
+struct Stats
+{
+    double median;
+    double p10;
+    double p90;
+    double min;
+};
+
+/// @brief ns per operation of f over repeated trials
+/// @param f runs one trial, returns a checksum
+/// @param setup runs before every trial, outside of the timing
+/// @param ops operations per trial
+/// @param trials
+/// @param sink keeps the results alive
+/// @return
+template <typename F, typename S> Stats measure(F &&f, S &&setup, uint64_t ops, int trials, U64 &sink)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        setup();
+        sink += f();
+    }
+
+    std::vector<double> ns(trials);
+    for (double &t : ns)
+    {
+        setup();
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        sink += f();
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        t = double(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()) / double(ops);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    auto percentile = [&](double p) { return ns[size_t(p * double(trials - 1) + 0.5)]; };
+
+    return {percentile(0.5), percentile(0.1), percentile(0.9), ns[0]};
+}
+
+/// @brief collects the fen of every position up to depth plies below board
+/// @param board
+/// @param depth
+/// @param fens
+void collect(Board &board, int depth, std::vector<std::string> &fens)
+{
+    fens.push_back(board.getFen());
+    if (depth == 0)
+        return;
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        collect(board, depth - 1, fens);
+        board.unmakeMove(ext.move);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const std::string filter = argc > 1 ? argv[1] : "";
+    const int trials = std::max(1, argc > 2 ? std::stoi(argv[2]) : 21);
+
+    std::vector<std::string> all;
+    for (const char *fen : ROOTS)
+    {
+        Board board(fen);
+        collect(board, 3, all);
+    }
+
+    std::vector<std::string> fens;
+    for (int i = 0; i < POSITIONS; i++)
+        fens.push_back(all[size_t(i) * all.size() / POSITIONS]);
+
+    std::vector<Board> boards(fens.size());
+    std::vector<Movelist> moves(fens.size());
+    uint64_t moveCount = 0;
+    for (size_t i = 0; i < fens.size(); i++)
+    {
+        boards[i].applyFen(fens[i]);
+        Movegen::legalmoves<ALL>(boards[i], moves[i]);
+        moveCount += moves[i].size;
+    }
+
+    // random occupancies for the slider lookups
+    std::vector<U64> occupancies(1 << 14);
+    U64 seed = 0x9E3779B97F4A7C15ULL;
+    for (U64 &occ : occupancies)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        occ = seed & (seed >> 11);
+    }
+
+    std::cout << fens.size() << " positions, " << moveCount << " moves, " << trials << " trials, slider backend "
+              << SLIDER_BACKEND << "\n\n"
+              << std::left << std::setw(26) << "benchmark" << std::setw(10) << "ops" << std::right << std::setw(10)
+              << "median ns" << std::setw(10) << "p10" << std::setw(10) << "p90" << std::setw(10) << "min"
+              << std::setw(12) << "Mops/s" << std::endl;
+
+    U64 sink = 0;
+
+    auto runWithSetup = [&](const std::string &name, uint64_t ops, auto &&setup, auto &&f) {
+        if (name.find(filter) == std::string::npos)
+            return;
+
+        const Stats s = measure(f, setup, ops, trials, sink);
+        std::cout << std::left << std::setw(26) << name << std::setw(10) << ops << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << s.median << std::setw(10) << s.p10 << std::setw(10)
+                  << s.p90 << std::setw(10) << s.min << std::setw(12) << 1000.0 / s.median << std::endl;
+    };
+
+    auto run = [&](const std::string &name, uint64_t ops, auto &&f) { runWithSetup(name, ops, []() {}, f); };
+
+    run("makeMove+unmakeMove", moveCount, [&]() {
+        U64 sum = 0;
+        for (size_t i = 0; i < boards.size(); i++)
+        {
+            for (const auto &ext : moves[i])
+            {
+                boards[i].makeMove(ext.move);
+                sum += boards[i].hashKey;
+                boards[i].unmakeMove(ext.move);
+            }
+        }
+        return sum;
+    });
+
+    // updateHash pushes every key on the hash history, the setup empties it again
+    auto resetBoards = [&]() {
+        for (size_t i = 0; i < boards.size(); i++)
+            boards[i].applyFen(fens[i]);
+    };
+
+    runWithSetup("updateHash", moveCount, resetBoards, [&]() {
+        U64 sum = 0;
+        for (size_t i = 0; i < boards.size(); i++)
+        {
+            Board &board = boards[i];
+            const U64 hashKey = board.hashKey;
+            const Square enPassant = board.enPassantSquare;
+            const uint8_t castling = board.castlingRights;
+            const uint8_t halfMoves = board.halfMoveClock;
+            const U64 pawnKey = board.pawnKey;
+            const U64 materialKey = board.materialKey;
+            const U64 nonPawnKey[2] = {board.nonPawnKey[0], board.nonPawnKey[1]};
+
+            for (const auto &ext : moves[i])
+            {
+                const Move move = ext.move;
+                const Piece capture = board.pieceAtB(to(move));
+                const bool isCastling = piece(move) == KING && capture == makePiece(ROOK, board.sideToMove);
+                const bool ep = piece(move) == PAWN && !promoted(move) && to(move) == board.enPassantSquare;
+
+                board.updateHash(move, isCastling, ep);
+                sum += board.hashKey;
+
+                board.hashKey = hashKey;
+                board.enPassantSquare = enPassant;
+                board.castlingRights = castling;
+                board.halfMoveClock = halfMoves;
+                board.pawnKey = pawnKey;
+                board.materialKey = materialKey;
+                board.nonPawnKey[0] = nonPawnKey[0];
+                board.nonPawnKey[1] = nonPawnKey[1];
+            }
+        }
+        return sum;
+    });
+
+    run("legalmoves<ALL>", boards.size(), [&]() {
+        U64 sum = 0;
+        Movelist list;
+        for (Board &board : boards)
+        {
+            Movegen::legalmoves<ALL>(board, list);
+            sum += list.size;
+        }
+        return sum;
+    });
+
+    run("legalmoves<CAPTURE>", boards.size(), [&]() {
+        U64 sum = 0;
+        Movelist list;
+        for (Board &board : boards)
+        {
+            Movegen::legalmoves<CAPTURE>(board, list);
+            sum += list.size;
+        }
+        return sum;
+    });
+
+    run("countLegalMoves<ALL>", boards.size(), [&]() {
+        U64 sum = 0;
+        for (Board &board : boards)
+            sum += Movegen::countLegalMoves<ALL>(board);
+        return sum;
+    });
+
+    run("isSquareAttacked", boards.size() * 64, [&]() {
+        U64 sum = 0;
+        for (const Board &board : boards)
+        {
+            for (Square sq = SQ_A1; sq <= SQ_H8; sq = Square(sq + 1))
+                sum += board.isSquareAttacked(~board.sideToMove, sq);
+        }
+        return sum;
+    });
+
+    run("attackedSquares", boards.size(), [&]() {
+        U64 sum = 0;
+        for (const Board &board : boards)
+            sum += board.attackedSquares(~board.sideToMove);
+        return sum;
+    });
+
+    run("getFen", boards.size(), [&]() {
+        U64 sum = 0;
+        for (const Board &board : boards)
+            sum += board.getFen().size();
+        return sum;
+    });
+
+    run("writeFen", boards.size(), [&]() {
+        U64 sum = 0;
+        char buffer[MAX_FEN_LENGTH];
+        for (const Board &board : boards)
+            sum += board.writeFen(buffer);
+        return sum;
+    });
+
+    run("applyFen", fens.size(), [&]() {
+        U64 sum = 0;
+        Board board;
+        for (const std::string &fen : fens)
+        {
+            board.applyFen(fen);
+            sum += board.hashKey;
+        }
+        return sum;
+    });
+
+    run("RookAttacks", occupancies.size(), [&]() {
+        U64 sum = 0;
+        for (size_t i = 0; i < occupancies.size(); i++)
+            sum += RookAttacks(Square(i & 63), occupancies[i] ^ (sum & 1));
+        return sum;
+    });
+
+    run("BishopAttacks", occupancies.size(), [&]() {
+        U64 sum = 0;
+        for (size_t i = 0; i < occupancies.size(); i++)
+            sum += BishopAttacks(Square(i & 63), occupancies[i] ^ (sum & 1));
+        return sum;
+    });
+
+    run("SliderAttacks", boards.size(), [&]() {
+        U64 sum = 0;
+        for (const Board &board : boards)
+        {
+            const Color c = board.sideToMove;
+            sum += SliderAttacks(board.pieces(ROOK, c) | board.pieces(QUEEN, c),
+                                 board.pieces(BISHOP, c) | board.pieces(QUEEN, c), board.All());
+        }
+        return sum;
+    });
+
+    // keys spread over a table larger than the caches
+    TranspositionTable tt(256);
+    std::vector<U64> keys(1 << 16);
+    for (U64 &key : keys)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        key = seed;
+    }
+
+    run("tt.store", keys.size(), [&]() {
+        for (size_t i = 0; i < keys.size(); i++)
+            tt.store(keys[i], Move(keys[i] >> 16), int16_t(keys[i] >> 32), int(i & 31), BOUND_EXACT);
+        return U64(tt.hashfull());
+    });
+
+    run("tt.probe", keys.size(), [&]() {
+        U64 sum = 0;
+        TTData data;
+        for (const U64 key : keys)
+            sum += tt.probe(key, data) ? data.move : 0;
+        return sum;
+    });
+
+    run("tt.probe prefetched", keys.size(), [&]() {
+        U64 sum = 0;
+        TTData data;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            tt.prefetch(keys[(i + 8) & (keys.size() - 1)]);
+            sum += tt.probe(keys[i], data) ? data.move : 0;
+        }
+        return sum;
+    });
+
+    std::cout << "\nchecksum " << sink << std::endl;
+
+    return 0;
+}
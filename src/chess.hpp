@@ -9,12 +9,34 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "sliders.hpp"
 
+/********************
+ * Slider attacks backend, compile with -DUSE_PEXT (make pext)
+ * to index the attack tables with PEXT. Without BMI2 the fancy
+ * magics are used anyway.
+ * -DUSE_OBSTRUCTION (make lowmem) computes the attacks with
+ * obstruction difference from 4 KB of masks instead of 700 KB of tables.
+ *******************/
+#if defined(USE_PEXT) && defined(__BMI2__)
+using namespace Chess_Lookup::Pext;
+#define SLIDER_BACKEND "pext"
+#elif defined(USE_OBSTRUCTION)
+using namespace Chess_Lookup::Obstruction;
+#define SLIDER_BACKEND "obstruction"
+#else
 using namespace Chess_Lookup::Fancy;
+#define SLIDER_BACKEND "fancy"
+#endif
 
 using Eval_Type = std::int16_t;
 
@@ -32,7 +54,11 @@ enum Movetype : uint8_t
 {
     ALL,
     CAPTURE,
-    QUIET
+    QUIET,
+    // all legal moves of a position in check, same as ALL otherwise
+    EVASIONS,
+    // quiet moves that give check, without castling
+    QUIET_CHECKS
 };
 
 enum Move : uint16_t
@@ -150,6 +176,12 @@ const std::string squareToString[MAX_SQ] = {
 static constexpr int MAX_PLY = 120;
 static constexpr int MAX_MOVES = 128;
 
+// longest fen Board::writeFen can produce, with some room to spare
+static constexpr int MAX_FEN_LENGTH = 128;
+
+// longest san moveToSan can produce, "exd8=Q+" or "Qh4xe1#"
+static constexpr int MAX_SAN_LENGTH = 8;
+
 static constexpr U64 WK_CASTLE_MASK = (1ULL << SQ_F1) | (1ULL << SQ_G1);
 static constexpr U64 WQ_CASTLE_MASK = (1ULL << SQ_D1) | (1ULL << SQ_C1) | (1ULL << SQ_B1);
 
@@ -518,10 +550,62 @@ static std::unordered_map<PieceType, char> PieceTypeToPromPiece(
 static std::unordered_map<char, PieceType> pieceToInt(
     {{'n', KNIGHT}, {'b', BISHOP}, {'r', ROOK}, {'q', QUEEN}, {'N', KNIGHT}, {'B', BISHOP}, {'R', ROOK}, {'Q', QUEEN}});
 
-static std::unordered_map<Square, CastlingRight> castlingMapRook({{SQ_A1, wq}, {SQ_H1, wk}, {SQ_A8, bq}, {SQ_H8, bk}});
+// castling rights that survive a move from or to the square,
+// castlingRights &= CASTLING_MASK[from] & CASTLING_MASK[to]
+// clang-format off
+static constexpr uint8_t CASTLING_MASK[MAX_SQ] = {
+    15 & ~wq, 15, 15, 15, 15 & ~(wk | wq), 15, 15, 15 & ~wk,
+    15,       15, 15, 15, 15,              15, 15, 15,
+    15,       15, 15, 15, 15,              15, 15, 15,
+    15,       15, 15, 15, 15,              15, 15, 15,
+    15,       15, 15, 15, 15,              15, 15, 15,
+    15,       15, 15, 15, 15,              15, 15, 15,
+    15,       15, 15, 15, 15,              15, 15, 15,
+    15 & ~bq, 15, 15, 15, 15 & ~(bk | bq), 15, 15, 15 & ~bk,
+};
+// clang-format on
 
 static std::unordered_map<char, CastlingRight> readCastleString({{'K', wk}, {'k', bk}, {'Q', wq}, {'q', bq}});
 
+// fen characters indexed by Piece
+static constexpr char PIECE_TO_CHAR[] = "PNBRQKpnbrqk.";
+
+/// @brief the piece of a fen character
+/// @param c
+/// @return None for anything that is not a piece
+inline constexpr Piece charToPieceFen(char c)
+{
+    switch (c)
+    {
+    case 'P':
+        return WhitePawn;
+    case 'N':
+        return WhiteKnight;
+    case 'B':
+        return WhiteBishop;
+    case 'R':
+        return WhiteRook;
+    case 'Q':
+        return WhiteQueen;
+    case 'K':
+        return WhiteKing;
+    case 'p':
+        return BlackPawn;
+    case 'n':
+        return BlackKnight;
+    case 'b':
+        return BlackBishop;
+    case 'r':
+        return BlackRook;
+    case 'q':
+        return BlackQueen;
+    case 'k':
+        return BlackKing;
+    default:
+        return None;
+    }
+}
+
 // *******************
 // Move encoding
 // *******************
@@ -563,14 +647,30 @@ struct State
     uint8_t castling{};
     uint8_t halfMove{};
     Piece capturedPiece = None;
+    U64 pawnKey{};
+    U64 materialKey{};
+    U64 nonPawnKey[2]{};
     State(Square enpassantCopy = {}, uint8_t castlingRightsCopy = {}, uint8_t halfMoveCopy = {},
-          Piece capturedPieceCopy = None)
+          Piece capturedPieceCopy = None, U64 pawnKeyCopy = {}, U64 materialKeyCopy = {},
+          const U64 *nonPawnKeyCopy = nullptr)
         : enPassant(enpassantCopy), castling(castlingRightsCopy), halfMove(halfMoveCopy),
-          capturedPiece(capturedPieceCopy)
+          capturedPiece(capturedPieceCopy), pawnKey(pawnKeyCopy), materialKey(materialKeyCopy),
+          nonPawnKey{nonPawnKeyCopy ? nonPawnKeyCopy[0] : 0, nonPawnKeyCopy ? nonPawnKeyCopy[1] : 0}
     {
     }
 };
 
+/// @brief movegen masks of one ply, kept on a stack when Board::cacheMovegen is enabled
+struct MovegenState
+{
+    U64 pinHV;
+    U64 pinD;
+    U64 checkMask;
+    U64 seen;
+    uint8_t doubleCheck;
+    bool valid;
+};
+
 struct ExtMove
 {
     int value;
@@ -850,6 +950,136 @@ inline U64 KingAttacks(Square sq)
     return KING_ATTACKS_TABLE[sq];
 }
 
+/// @brief union of the attacks of all rooks and all bishops, one lookup per slider
+/// @param rooks rooks and queens
+/// @param bishops bishops and queens
+/// @param occ
+/// @return
+inline U64 SliderAttacksScalar(U64 rooks, U64 bishops, U64 occ)
+{
+    U64 attacks = 0ULL;
+    while (rooks)
+        attacks |= RookAttacks(poplsb(rooks), occ);
+    while (bishops)
+        attacks |= BishopAttacks(poplsb(bishops), occ);
+    return attacks;
+}
+
+#if defined(__AVX2__)
+/********************
+ * Kogge-Stone occluded fill of four directions at once.
+ * Lanes: north, east, north east, north west when shifting left,
+ * south, west, south west, south east when shifting right.
+ * gen spreads over the empty squares in log2(7) = 3 steps, the final
+ * shift adds the blocker, the mask removes the wrap around the a/h file.
+ *******************/
+template <bool left> inline __m256i OccludedFill(__m256i gen, __m256i empty, __m256i mask)
+{
+    const __m256i s1 = _mm256_set_epi64x(7, 9, 1, 8);
+    const __m256i s2 = _mm256_set_epi64x(14, 18, 2, 16);
+    const __m256i s4 = _mm256_set_epi64x(28, 36, 4, 32);
+
+    auto shift = [](__m256i bb, __m256i s) { return left ? _mm256_sllv_epi64(bb, s) : _mm256_srlv_epi64(bb, s); };
+
+    __m256i pro = _mm256_and_si256(empty, mask);
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift(gen, s1)));
+    pro = _mm256_and_si256(pro, shift(pro, s1));
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift(gen, s2)));
+    pro = _mm256_and_si256(pro, shift(pro, s2));
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift(gen, s4)));
+
+    return _mm256_and_si256(shift(gen, s1), mask);
+}
+
+/// @brief union of the attacks of all rooks and all bishops, all eight directions filled with AVX2
+/// @param rooks rooks and queens
+/// @param bishops bishops and queens
+/// @param occ
+/// @return
+inline U64 SliderAttacksFill(U64 rooks, U64 bishops, U64 occ)
+{
+    constexpr U64 notA = ~MASK_FILE[FILE_A];
+    constexpr U64 notH = ~MASK_FILE[FILE_H];
+
+    const __m256i gen = _mm256_set_epi64x(bishops, bishops, rooks, rooks);
+    const __m256i empty = _mm256_set1_epi64x(~occ);
+
+    const __m256i up = OccludedFill<true>(gen, empty, _mm256_set_epi64x(notH, notA, notA, ~0ULL));
+    const __m256i down = OccludedFill<false>(gen, empty, _mm256_set_epi64x(notA, notH, notH, ~0ULL));
+
+    const __m256i lanes = _mm256_or_si256(up, down);
+    const __m128i halves = _mm_or_si128(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1));
+
+    return _mm_cvtsi128_si64(halves) | _mm_extract_epi64(halves, 1);
+}
+#endif
+
+/********************
+ * Union of all slider attacks of one side, used for the seen squares.
+ * Compile with -DUSE_AVX2_FILL (make fill) to use the AVX2 Kogge-Stone
+ * fill instead of one lookup per slider.
+ *******************/
+inline U64 SliderAttacks(U64 rooks, U64 bishops, U64 occ)
+{
+#if defined(USE_AVX2_FILL) && defined(__AVX2__)
+    return SliderAttacksFill(rooks, bishops, occ);
+#else
+    return SliderAttacksScalar(rooks, bishops, occ);
+#endif
+}
+
+/********************
+ * Geometry tables, computed at compile time and shared by every Board.
+ * rays[d][sq]       squares from sq in direction d up to the edge
+ * between[sq1][sq2] squares strictly between two aligned squares
+ * line[sq1][sq2]    the whole line through two aligned squares, edge to edge
+ * between and line are 0 for squares that share no line.
+ *******************/
+struct Geometry
+{
+    // north, north east, east, south east, south, south west, west, north west
+    static constexpr int FILE_STEP[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+    static constexpr int RANK_STEP[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+
+    U64 rays[8][MAX_SQ] = {};
+    U64 between[MAX_SQ][MAX_SQ] = {};
+    U64 line[MAX_SQ][MAX_SQ] = {};
+
+    constexpr Geometry()
+    {
+        for (int sq = 0; sq < MAX_SQ; sq++)
+        {
+            for (int d = 0; d < 8; d++)
+            {
+                U64 ray = 0ULL;
+                int f = sq % 8 + FILE_STEP[d], r = sq / 8 + RANK_STEP[d];
+                for (; f >= 0 && f < 8 && r >= 0 && r < 8; f += FILE_STEP[d], r += RANK_STEP[d])
+                {
+                    between[sq][r * 8 + f] = ray;
+                    ray |= 1ULL << (r * 8 + f);
+                }
+                rays[d][sq] = ray;
+            }
+        }
+
+        for (int sq = 0; sq < MAX_SQ; sq++)
+        {
+            for (int d = 0; d < 8; d++)
+            {
+                const U64 full = rays[d][sq] | rays[(d + 4) % 8][sq] | (1ULL << sq);
+                for (U64 ray = rays[d][sq]; ray; ray &= ray - 1)
+                    line[sq][__builtin_ctzll(ray)] = full;
+            }
+        }
+    }
+};
+
+inline constexpr Geometry GEOMETRY{};
+
+inline constexpr const U64 (&RAYS)[8][MAX_SQ] = GEOMETRY.rays;
+inline constexpr const U64 (&SQUARES_BETWEEN_BB)[MAX_SQ][MAX_SQ] = GEOMETRY.between;
+inline constexpr const U64 (&LINE_BB)[MAX_SQ][MAX_SQ] = GEOMETRY.line;
+
 class Board
 {
   public:
@@ -876,6 +1106,16 @@ class Board
     // current hashkey
     U64 hashKey;
 
+    // zobrist keys of the pawns only
+    U64 pawnKey = 0;
+
+    // material signature, the key of the n-th piece of a kind is the key of that piece on square n,
+    // equal piece counts give equal keys
+    U64 materialKey = 0;
+
+    // zobrist keys of the knights, bishops, rooks, queens and king of each color
+    U64 nonPawnKey[2] = {};
+
     U64 piecesBB[12] = {};
     Piece board[MAX_SQ];
 
@@ -907,7 +1147,15 @@ class Board
     U64 occAll;
     U64 enemyEmptyBB;
 
-    U64 SQUARES_BETWEEN_BB[MAX_SQ][MAX_SQ];
+    // opt-in, see cacheMovegen()
+    bool movegenCacheEnabled = false;
+
+    // pinHV, pinD, checkMask, seen and doubleCheck belong to the current position
+    bool movegenValid = false;
+
+    // opt-in, see setPrefetch()
+    void (*prefetchHook)(const void *, U64) = nullptr;
+    const void *prefetchContext = nullptr;
 
   private:
     // keeps track of previous hashes, used for
@@ -916,9 +1164,11 @@ class Board
 
     std::vector<State> stateHistory;
 
+    std::vector<MovegenState> movegenHistory;
+
   public:
-    /// @brief constructor for the board, loads startpos and initializes SQUARES_BETWEEN_BB array
-    Board(std::string fen = DEFAULT_POS);
+    /// @brief constructor for the board, loads startpos
+    Board(std::string_view fen = DEFAULT_POS);
 
     /// @brief Finds what piece is on the square using bitboards (slow)
     /// @param sq
@@ -935,14 +1185,20 @@ class Board
     /// @return found piece otherwise None
     Piece pieceAtB(Square sq) const;
 
-    /// @brief applys a new Fen to the board
+    /// @brief applys a new Fen to the board, single pass without allocations.
+    /// EPD lines work as well, their operations are ignored.
     /// @param fen
-    void applyFen(const std::string &fen);
+    void applyFen(std::string_view fen);
 
     /// @brief returns a Fen string of the current board
     /// @return fen string
     std::string getFen() const;
 
+    /// @brief writes the Fen of the current board to buffer, without a null terminator
+    /// @param buffer at least MAX_FEN_LENGTH chars
+    /// @return the number of chars written
+    int writeFen(char *buffer) const;
+
     /// @brief detects if the position is a repetition by default 1, fide would be 2
     /// @param draw
     /// @return true for repetition otherwise false
@@ -996,6 +1252,11 @@ class Board
     /// @return
     bool isSquareAttacked(Color c, Square sq) const;
 
+    /// @brief all squares attacked by color c
+    /// @param c
+    /// @return
+    U64 attackedSquares(Color c) const;
+
     void updateHash(Move move, bool isCastling, bool ep);
 
     /// @brief plays the move on the internal board
@@ -1009,6 +1270,26 @@ class Board
     /// @brief make a nullmove
     void makeNullMove();
 
+    /// @brief when enabled the movegen masks (checkmask, pins, seen squares) are
+    /// computed at most once per position, makeMove pushes them on a stack and
+    /// unmakeMove restores them. Pieces placed by hand outside of makeMove
+    /// require calling cacheMovegen again to drop the current masks.
+    /// Undoing moves made before it was enabled is fine, the masks of those
+    /// positions are recomputed.
+    /// @param enable
+    void cacheMovegen(bool enable);
+
+    /// @brief makeMove calls hook(context, hashKey) with the key of the child position
+    /// right after updateHash, before the pieces are moved, so a hash table can prefetch
+    /// its bucket, see TranspositionTable::prefetchHook. nullptr turns it off
+    /// @param hook
+    /// @param context
+    void setPrefetch(void (*hook)(const void *, U64), const void *context)
+    {
+        prefetchHook = hook;
+        prefetchContext = context;
+    }
+
     /// @brief unmake a nullmove
     void unmakeNullMove();
 
@@ -1031,14 +1312,24 @@ class Board
     U64 attacksByPiece(PieceType pt, Square sq, Color c) const;
 
     friend inline std::ostream &operator<<(std::ostream &os, const Board &b);
+    friend struct PackedBoard;
 
   private:
     /// @brief calculate the current zobrist hash from scratch
     /// @return
     U64 zobristHash() const;
 
-    /// @brief initialize SQUARES_BETWEEN_BB array
-    void initializeLookupTables();
+    /// @brief empties the board before a new position is placed
+    void clearPieces();
+
+    /// @brief hashes the placed position and starts a new game history
+    void resetHistory();
+
+    /// @brief pawn, material and non pawn keys from scratch
+    void computeKeys();
+
+    /// @brief key of the n-th piece of a kind in the material key
+    U64 materialKeyPiece(Piece piece, int n) const;
 
     // update the hash
 
@@ -1047,8 +1338,7 @@ class Board
     U64 updateKeyEnPassant(Square sq) const;
     U64 updateKeySideToMove() const;
 
-    void removeCastlingRightsAll(Color c);
-    void removeCastlingRightsRook(Square sq);
+    void restoreMovegen();
 
     // Fork additions:
     enum Eval_Mode {
@@ -1069,15 +1359,17 @@ public:
     Eval_Type eval();
 
     bool in_check() const {
+        if (movegenValid)
+            return checkMask != DEFAULT_CHECKMASK;
         return isSquareAttacked(~sideToMove, KingSQ(sideToMove));
     }
 };
 
-inline Board::Board(std::string fen)
+inline Board::Board(std::string_view fen)
 {
-    initializeLookupTables();
     stateHistory.reserve(MAX_PLY);
     hashHistory.reserve(512);
+    movegenHistory.reserve(MAX_PLY);
 
     sideToMove = White;
     enPassantSquare = NO_SQ;
@@ -1121,7 +1413,7 @@ inline PieceType Board::pieceTypeAtB(Square sq) const
     return type_of_piece(board[sq]);
 }
 
-inline void Board::applyFen(const std::string &fen)
+inline void Board::clearPieces()
 {
     for (Piece p = WhitePawn; p < None; p++)
     {
@@ -1131,47 +1423,91 @@ inline void Board::applyFen(const std::string &fen)
     endgame_PST = 0;
     game_phase = 0;
 
-    const std::vector<std::string> params = splitInput(fen);
+    std::fill(std::begin(board), std::end(board), None);
+}
 
-    const std::string position = params[0];
-    const std::string move_right = params[1];
-    const std::string castling = params[2];
-    const std::string en_passant = params[3];
+inline void Board::resetHistory()
+{
+    hashKey = zobristHash();
+    computeKeys();
 
-    const std::string half_move_clock = params.size() > 4 ? params[4] : "0";
-    const std::string full_move_counter = params.size() > 4 ? params[5] : "1";
+    hashHistory.clear();
+    stateHistory.clear();
+    movegenHistory.clear();
+    movegenValid = false;
 
-    sideToMove = (move_right == "w") ? White : Black;
+    hashHistory.push_back(hashKey);
+}
 
-    std::fill(std::begin(board), std::end(board), None);
+inline void Board::applyFen(std::string_view fen)
+{
+    clearPieces();
+
+    size_t i = 0;
+
+    // the next field, fields are separated by one or more spaces
+    auto field = [&]() {
+        while (i < fen.size() && fen[i] == ' ')
+            i++;
+        const size_t start = i;
+        while (i < fen.size() && fen[i] != ' ')
+            i++;
+        return fen.substr(start, i - start);
+    };
+
+    // a move counter, an EPD operation in its place gives the default
+    auto number = [](std::string_view str, int fallback) {
+        if (str.empty() || str[0] < '0' || str[0] > '9')
+            return fallback;
+        int n = 0;
+        for (size_t j = 0; j < str.size() && str[j] >= '0' && str[j] <= '9'; j++)
+            n = n * 10 + (str[j] - '0');
+        return n;
+    };
+
+    const std::string_view position = field();
+    const std::string_view move_right = field();
+    const std::string_view castling = field();
+    const std::string_view en_passant = field();
+    const std::string_view half_move_clock = field();
+
+    // EPD operations end the fields, in "fen ;D1 20" the 20 is no move counter
+    const bool counters = !half_move_clock.empty() && half_move_clock[0] >= '0' && half_move_clock[0] <= '9';
+    const std::string_view full_move_counter = counters ? field() : std::string_view();
+
+    sideToMove = (move_right == "w") ? White : Black;
 
     Square square = Square(56);
-    for (int index = 0; index < static_cast<int>(position.size()); index++)
+    for (const char curr : position)
     {
-        char curr = position[index];
-        if (charToPiece.find(curr) != charToPiece.end())
+        const Piece piece = charToPieceFen(curr);
+        if (piece != None)
         {
-            const Piece piece = charToPiece[curr];
             placePiece(piece, square);
 
             square = Square(square + 1);
         }
         else if (curr == '/')
             square = Square(square - 16);
-        else if (isdigit(curr))
+        else if (curr >= '1' && curr <= '8')
             square = Square(square + (curr - '0'));
     }
 
-    removeCastlingRightsAll(White);
-    removeCastlingRightsAll(Black);
+    castlingRights = 0;
 
-    for (size_t i = 0; i < castling.size(); i++)
+    for (const char c : castling)
     {
-        if (readCastleString.find(castling[i]) != readCastleString.end())
-            castlingRights |= readCastleString[castling[i]];
+        if (c == 'K')
+            castlingRights |= wk;
+        else if (c == 'Q')
+            castlingRights |= wq;
+        else if (c == 'k')
+            castlingRights |= bk;
+        else if (c == 'q')
+            castlingRights |= bq;
     }
 
-    if (en_passant == "-")
+    if (en_passant.size() < 2)
     {
         enPassantSquare = NO_SQ;
     }
@@ -1183,97 +1519,101 @@ inline void Board::applyFen(const std::string &fen)
         enPassantSquare = Square((rank - 1) * 8 + file - 1);
     }
 
-    halfMoveClock = std::stoi(half_move_clock);
+    halfMoveClock = number(half_move_clock, 0);
 
     // full_move_counter actually half moves
-    fullMoveNumber = std::stoi(full_move_counter) * 2;
-
-    hashKey = zobristHash();
+    fullMoveNumber = number(full_move_counter, 1) * 2;
 
-    hashHistory.clear();
-    stateHistory.clear();
-
-    hashHistory.push_back(hashKey);
+    resetHistory();
 }
 
 inline std::string Board::getFen() const
 {
-    std::stringstream ss;
+    char buffer[MAX_FEN_LENGTH];
+    return std::string(buffer, writeFen(buffer));
+}
+
+inline int Board::writeFen(char *buffer) const
+{
+    char *out = buffer;
+
+    // writes a non negative number
+    auto number = [&out](int n) {
+        char digits[10];
+        int length = 0;
+        do
+        {
+            digits[length++] = char('0' + n % 10);
+            n /= 10;
+        } while (n);
+        while (length)
+            *out++ = digits[--length];
+    };
 
     // Loop through the ranks of the board in reverse order
     for (int rank = 7; rank >= 0; rank--)
     {
         int free_space = 0;
 
-        // Loop through the files of the board
         for (int file = 0; file < 8; file++)
         {
-            // Calculate the square index
-            int sq = rank * 8 + file;
-
-            // Get the piece at the current square
-            Piece piece = pieceAtB(Square(sq));
+            const Piece piece = pieceAtB(Square(rank * 8 + file));
 
-            // If there is a piece at the current square
             if (piece != None)
             {
-                // If there were any empty squares before this piece,
-                // append the number of empty squares to the FEN string
+                // empty squares before this piece
                 if (free_space)
                 {
-                    ss << free_space;
+                    *out++ = char('0' + free_space);
                     free_space = 0;
                 }
 
-                // Append the character representing the piece to the FEN string
-                ss << pieceToChar[piece];
+                *out++ = PIECE_TO_CHAR[piece];
             }
             else
             {
-                // If there is no piece at the current square, increment the
-                // counter for the number of empty squares
                 free_space++;
             }
         }
 
-        // If there are any empty squares at the end of the rank,
-        // append the number of empty squares to the FEN string
         if (free_space != 0)
-        {
-            ss << free_space;
-        }
+            *out++ = char('0' + free_space);
 
-        // Append a "/" character to the FEN string, unless this is the last rank
-        ss << (rank > 0 ? "/" : "");
+        if (rank > 0)
+            *out++ = '/';
     }
 
-    // Append " w " or " b " to the FEN string, depending on which player's turn it is
-    ss << (sideToMove == White ? " w " : " b ");
+    *out++ = ' ';
+    *out++ = sideToMove == White ? 'w' : 'b';
+    *out++ = ' ';
 
-    // Append the appropriate characters to the FEN string to indicate
-    // whether or not castling is allowed for each player
     if (castlingRights & wk)
-        ss << "K";
+        *out++ = 'K';
     if (castlingRights & wq)
-        ss << "Q";
+        *out++ = 'Q';
     if (castlingRights & bk)
-        ss << "k";
+        *out++ = 'k';
     if (castlingRights & bq)
-        ss << "q";
+        *out++ = 'q';
     if (castlingRights == 0)
-        ss << "-";
+        *out++ = '-';
+
+    *out++ = ' ';
 
-    // Append information about the en passant square (if any)
-    // and the halfmove clock and fullmove number to the FEN string
     if (enPassantSquare == NO_SQ)
-        ss << " - ";
+        *out++ = '-';
     else
-        ss << " " << squareToString[enPassantSquare] << " ";
+    {
+        *out++ = char('a' + square_file(enPassantSquare));
+        *out++ = char('1' + square_rank(enPassantSquare));
+    }
 
-    ss << int(halfMoveClock) << " " << int(fullMoveNumber / 2);
+    *out++ = ' ';
+    number(halfMoveClock);
+    *out++ = ' ';
+    number(fullMoveNumber / 2);
 
-    // Return the resulting FEN string
-    return ss.str();
+    return int(out - buffer);
 }
 
 inline bool Board::isRepetition(int draw) const
@@ -1341,6 +1681,22 @@ inline bool Board::isSquareAttacked(Color c, Square sq) const
     return false;
 }
 
+inline U64 Board::attackedSquares(Color c) const
+{
+    const U64 pawns = pieces(PAWN, c);
+    U64 knights = pieces(KNIGHT, c);
+
+    U64 attacks = c == White ? ((pawns << 7) & ~MASK_FILE[FILE_H]) | ((pawns << 9) & ~MASK_FILE[FILE_A])
+                             : ((pawns >> 7) & ~MASK_FILE[FILE_A]) | ((pawns >> 9) & ~MASK_FILE[FILE_H]);
+
+    while (knights)
+        attacks |= KnightAttacks(poplsb(knights));
+
+    attacks |= SliderAttacks(pieces(ROOK, c) | pieces(QUEEN, c), pieces(BISHOP, c) | pieces(QUEEN, c), All());
+
+    return attacks | KingAttacks(KingSQ(c));
+}
+
 inline void Board::updateHash(Move move, bool isCastling, bool ep)
 {
     PieceType pt = piece(move);
@@ -1354,14 +1710,15 @@ inline void Board::updateHash(Move move, bool isCastling, bool ep)
     if (enPassantSquare != NO_SQ)
         hashKey ^= updateKeyEnPassant(enPassantSquare);
 
-    hashKey ^= updateKeyCastling();
-
     enPassantSquare = NO_SQ;
 
+    // moves from or to a king or rook square drop the rights of that piece
+    const uint8_t rights = castlingRights & CASTLING_MASK[from_sq] & CASTLING_MASK[to_sq];
+    hashKey ^= castlingKey[castlingRights] ^ castlingKey[rights];
+    castlingRights = rights;
+
     if (pt == KING)
     {
-        removeCastlingRightsAll(sideToMove);
-
         if (isCastling)
         {
             const Piece rook = sideToMove == White ? WhiteRook : BlackRook;
@@ -1370,27 +1727,28 @@ inline void Board::updateHash(Move move, bool isCastling, bool ep)
 
             assert(type_of_piece(pieceAtB(to_sq)) == ROOK);
 
-            hashKey ^= updateKeyPiece(rook, to_sq);
-            hashKey ^= updateKeyPiece(rook, rookSQ);
-            hashKey ^= updateKeyPiece(p, from_sq);
-            hashKey ^= updateKeyPiece(p, kingToSq);
+            const U64 castlingKeys = updateKeyPiece(rook, to_sq) ^ updateKeyPiece(rook, rookSQ) ^
+                                     updateKeyPiece(p, from_sq) ^ updateKeyPiece(p, kingToSq);
+
+            hashKey ^= castlingKeys;
+            nonPawnKey[sideToMove] ^= castlingKeys;
 
             hashKey ^= updateKeySideToMove();
-            hashKey ^= updateKeyCastling();
 
             return;
         }
     }
-    else if (pt == ROOK)
-    {
-        removeCastlingRightsRook(from_sq);
-    }
     else if (pt == PAWN)
     {
         halfMoveClock = 0;
         if (ep)
         {
-            hashKey ^= updateKeyPiece(makePiece(PAWN, ~sideToMove), Square(to_sq ^ 8));
+            const Piece pawn = makePiece(PAWN, ~sideToMove);
+            const U64 key = updateKeyPiece(pawn, Square(to_sq ^ 8));
+
+            hashKey ^= key;
+            pawnKey ^= key;
+            materialKey ^= materialKeyPiece(pawn, popcount(piecesBB[pawn]) - 1);
         }
         else if (std::abs(from_sq - to_sq) == 16)
         {
@@ -1408,26 +1766,43 @@ inline void Board::updateHash(Move move, bool isCastling, bool ep)
     if (capture != None)
     {
         halfMoveClock = 0;
-        hashKey ^= updateKeyPiece(capture, to_sq);
-        if (type_of_piece(capture) == ROOK)
-            removeCastlingRightsRook(to_sq);
+
+        const U64 key = updateKeyPiece(capture, to_sq);
+        hashKey ^= key;
+        materialKey ^= materialKeyPiece(capture, popcount(piecesBB[capture]) - 1);
+
+        if (type_of_piece(capture) == PAWN)
+            pawnKey ^= key;
+        else
+            nonPawnKey[~sideToMove] ^= key;
     }
 
     if (promoted(move))
     {
         halfMoveClock = 0;
 
-        hashKey ^= updateKeyPiece(makePiece(PAWN, sideToMove), from_sq);
-        hashKey ^= updateKeyPiece(p, to_sq);
+        const Piece pawn = makePiece(PAWN, sideToMove);
+        const U64 pawnFrom = updateKeyPiece(pawn, from_sq);
+        const U64 promotedTo = updateKeyPiece(p, to_sq);
+
+        hashKey ^= pawnFrom ^ promotedTo;
+        pawnKey ^= pawnFrom;
+        nonPawnKey[sideToMove] ^= promotedTo;
+        materialKey ^= materialKeyPiece(pawn, popcount(piecesBB[pawn]) - 1) ^
+                       materialKeyPiece(p, popcount(piecesBB[p]));
     }
     else
     {
-        hashKey ^= updateKeyPiece(p, from_sq);
-        hashKey ^= updateKeyPiece(p, to_sq);
+        const U64 key = updateKeyPiece(p, from_sq) ^ updateKeyPiece(p, to_sq);
+
+        hashKey ^= key;
+        if (pt == PAWN)
+            pawnKey ^= key;
+        else
+            nonPawnKey[sideToMove] ^= key;
     }
 
     hashKey ^= updateKeySideToMove();
-    hashKey ^= updateKeyCastling();
 }
 
 inline void Board::makeMove(Move move)
@@ -1448,13 +1823,21 @@ inline void Board::makeMove(Move move)
     // STORE STATE HISTORY
     // *****************************
 
-    stateHistory.emplace_back(State(enPassantSquare, castlingRights, halfMoveClock, capture));
+    stateHistory.emplace_back(
+        State(enPassantSquare, castlingRights, halfMoveClock, capture, pawnKey, materialKey, nonPawnKey));
+
+    if (movegenCacheEnabled)
+    {
+        movegenHistory.push_back({pinHV, pinD, checkMask, seen, doubleCheck, movegenValid});
+        movegenValid = false;
+    }
 
     halfMoveClock++;
     fullMoveNumber++;
 
     bool ep = to_sq == enPassantSquare;
-    const bool isCastling = pt == KING && type_of_piece(capture) == ROOK && colorOf(from_sq) == colorOf(to_sq);
+    // castling is encoded as king captures own rook
+    const bool isCastling = pt == KING && capture == makePiece(ROOK, sideToMove);
 
     // *****************************
     // UPDATE HASH
@@ -1462,6 +1845,9 @@ inline void Board::makeMove(Move move)
 
     updateHash(move, isCastling, ep);
 
+    if (prefetchHook)
+        prefetchHook(prefetchContext, hashKey);
+
     // *****************************
     // UPDATE PIECES
     // *****************************
@@ -1516,12 +1902,19 @@ inline void Board::unmakeMove(Move move)
     const State restore = stateHistory.back();
     stateHistory.pop_back();
 
+    if (movegenCacheEnabled)
+        restoreMovegen();
+
     hashKey = hashHistory.back();
     hashHistory.pop_back();
 
     enPassantSquare = restore.enPassant;
     castlingRights = restore.castling;
     halfMoveClock = restore.halfMove;
+    pawnKey = restore.pawnKey;
+    materialKey = restore.materialKey;
+    nonPawnKey[White] = restore.nonPawnKey[White];
+    nonPawnKey[Black] = restore.nonPawnKey[Black];
     Piece capture = restore.capturedPiece;
 
     fullMoveNumber--;
@@ -1579,10 +1972,19 @@ inline void Board::makeNullMove()
     stateHistory.emplace_back(State(enPassantSquare, castlingRights, halfMoveClock, None));
     sideToMove = ~sideToMove;
 
+    if (movegenCacheEnabled)
+    {
+        movegenHistory.push_back({pinHV, pinD, checkMask, seen, doubleCheck, movegenValid});
+        movegenValid = false;
+    }
+
     hashKey ^= updateKeySideToMove();
     if (enPassantSquare != NO_SQ)
         hashKey ^= updateKeyEnPassant(enPassantSquare);
 
+    if (prefetchHook)
+        prefetchHook(prefetchContext, hashKey);
+
     enPassantSquare = NO_SQ;
     fullMoveNumber++;
 }
@@ -1592,6 +1994,9 @@ inline void Board::unmakeNullMove()
     const State restore = stateHistory.back();
     stateHistory.pop_back();
 
+    if (movegenCacheEnabled)
+        restoreMovegen();
+
     enPassantSquare = restore.enPassant;
     castlingRights = restore.castling;
     halfMoveClock = restore.halfMove;
@@ -1604,7 +2009,34 @@ inline void Board::unmakeNullMove()
     sideToMove = ~sideToMove;
 }
 
-/*inline void Board::removePiece(Piece piece, Square sq)
+inline void Board::cacheMovegen(bool enable)
+{
+    movegenCacheEnabled = enable;
+    movegenValid = false;
+    movegenHistory.clear();
+}
+
+inline void Board::restoreMovegen()
+{
+    // the move was made before cacheMovegen(true), its masks were never pushed
+    if (movegenHistory.empty())
+    {
+        movegenValid = false;
+        return;
+    }
+
+    const MovegenState restore = movegenHistory.back();
+    movegenHistory.pop_back();
+
+    pinHV = restore.pinHV;
+    pinD = restore.pinD;
+    checkMask = restore.checkMask;
+    seen = restore.seen;
+    doubleCheck = restore.doubleCheck;
+    movegenValid = restore.valid;
+}
+
+inline void Board::removePiece(Piece piece, Square sq)
 {
     piecesBB[piece] &= ~(1ULL << sq);
     board[sq] = None;
@@ -1622,7 +2054,7 @@ inline void Board::movePiece(Piece piece, Square fromSq, Square toSq)
     piecesBB[piece] |= (1ULL << toSq);
     board[fromSq] = None;
     board[toSq] = piece;
-}*/
+}
 
 inline U64 Board::attacksByPiece(PieceType pt, Square sq, Color c) const
 {
@@ -1703,25 +2135,34 @@ inline U64 Board::zobristHash() const
     return hash ^ cast_hash ^ turn_hash ^ ep_hash;
 }
 
-inline void Board::initializeLookupTables()
+inline void Board::computeKeys()
 {
-    // initialize squares between table
-    U64 sqs;
-    for (Square sq1 = SQ_A1; sq1 <= SQ_H8; ++sq1)
+    pawnKey = 0;
+    materialKey = 0;
+    nonPawnKey[White] = 0;
+    nonPawnKey[Black] = 0;
+
+    for (Piece p = WhitePawn; p < None; p++)
     {
-        for (Square sq2 = SQ_A1; sq2 <= SQ_H8; ++sq2)
+        U64 bb = piecesBB[p];
+        for (int n = 0; bb; n++)
         {
-            sqs = (1ULL << sq1) | (1ULL << sq2);
-            if (sq1 == sq2)
-                SQUARES_BETWEEN_BB[sq1][sq2] = 0ull;
-            else if (square_file(sq1) == square_file(sq2) || square_rank(sq1) == square_rank(sq2))
-                SQUARES_BETWEEN_BB[sq1][sq2] = RookAttacks(sq1, sqs) & RookAttacks(sq2, sqs);
-            else if (diagonal_of(sq1) == diagonal_of(sq2) || anti_diagonal_of(sq1) == anti_diagonal_of(sq2))
-                SQUARES_BETWEEN_BB[sq1][sq2] = BishopAttacks(sq1, sqs) & BishopAttacks(sq2, sqs);
+            const Square sq = poplsb(bb);
+            materialKey ^= materialKeyPiece(p, n);
+
+            if (type_of_piece(p) == PAWN)
+                pawnKey ^= updateKeyPiece(p, sq);
+            else
+                nonPawnKey[p < BlackPawn ? White : Black] ^= updateKeyPiece(p, sq);
         }
     }
 }
 
+inline U64 Board::materialKeyPiece(Piece piece, int n) const
+{
+    return RANDOM_ARRAY[64 * hash_piece[piece] + n];
+}
+
 inline U64 Board::updateKeyPiece(Piece piece, Square sq) const
 {
     return RANDOM_ARRAY[64 * hash_piece[piece] + sq];
@@ -1742,61 +2183,432 @@ inline U64 Board::updateKeySideToMove() const
     return RANDOM_ARRAY[780];
 }
 
-inline void Board::removeCastlingRightsAll(Color c)
+/********************
+ * Position is a compact, trivially copyable alternative to Board.
+ * It only keeps the state needed to generate moves and play them,
+ * play() returns the child position by value (copy-make) so there is
+ * no history to undo and copies can be handed to other threads freely.
+ *******************/
+struct alignas(64) Position
 {
-    if (c == White)
+    U64 piecesBB[12] = {};
+
+    // current hashkey, equal to Board::hashKey of the same position
+    U64 hashKey = 0;
+
+    Color sideToMove = White;
+
+    // NO_SQ when enpassant is not possible
+    Square enPassantSquare = NO_SQ;
+
+    uint8_t castlingRights = 0;
+
+    uint8_t halfMoveClock = 0;
+
+    // counts half moves, same as Board::fullMoveNumber
+    uint16_t fullMoveNumber = 2;
+
+    Position() = default;
+
+    explicit Position(const Board &board)
+        : hashKey(board.hashKey), sideToMove(board.sideToMove), enPassantSquare(board.enPassantSquare),
+          castlingRights(board.castlingRights), halfMoveClock(board.halfMoveClock),
+          fullMoveNumber(board.fullMoveNumber)
     {
-        castlingRights &= ~(wk | wq);
+        std::copy(std::begin(board.piecesBB), std::end(board.piecesBB), std::begin(piecesBB));
     }
-    else if (c == Black)
+
+    template <Piece p> constexpr U64 pieces() const
     {
-        castlingRights &= ~(bk | bq);
+        return piecesBB[p];
     }
-}
 
-inline void Board::removeCastlingRightsRook(Square sq)
-{
-    if (castlingMapRook.find(sq) != castlingMapRook.end())
+    template <PieceType p, Color c> constexpr U64 pieces() const
     {
-        castlingRights &= ~castlingMapRook[sq];
+        return piecesBB[p + c * 6];
     }
-}
 
-/// @brief uci representation of a move
-/// @param move
-/// @return
-inline std::string convertMoveToUci(Move move)
-{
-    std::stringstream ss;
+    inline constexpr U64 pieces(PieceType p, Color c) const
+    {
+        return piecesBB[p + c * 6];
+    }
 
-    // Get the from and to squares
-    Square from_sq = from(move);
-    Square to_sq = to(move);
+    U64 Us(Color c) const
+    {
+        return piecesBB[PAWN + c * 6] | piecesBB[KNIGHT + c * 6] | piecesBB[BISHOP + c * 6] | piecesBB[ROOK + c * 6] |
+               piecesBB[QUEEN + c * 6] | piecesBB[KING + c * 6];
+    }
 
-    if (piece(move) == KING && square_distance(from_sq, to_sq) > 1) { // castling
-        if (square_file(to_sq) == FILE_A) {
-            to_sq = file_rank_square(FILE_C, square_rank(to_sq));
-        } else if (square_file(to_sq) == FILE_H) {
-            to_sq = file_rank_square(FILE_G, square_rank(to_sq));
+    U64 All() const
+    {
+        return Us(White) | Us(Black);
+    }
+
+    Square KingSQ(Color c) const
+    {
+        return lsb(pieces(KING, c));
+    }
+
+    /// @brief Finds what piece is on the square using bitboards
+    /// @param sq
+    /// @return found piece otherwise None
+    Piece pieceAt(Square sq) const
+    {
+        for (Piece p = WhitePawn; p < None; p++)
+        {
+            if (piecesBB[p] & (1ULL << sq))
+                return p;
         }
+        return None;
     }
 
-    // Add the from and to squares to the string stream
-    ss << squareToString[from_sq];
-    ss << squareToString[to_sq];
+    /// @brief is square attacked by color c
+    /// @param c
+    /// @param sq
+    /// @return
+    bool isSquareAttacked(Color c, Square sq) const
+    {
+        const U64 bb = All();
+        return (pieces(PAWN, c) & PawnAttacks(sq, ~c)) || (pieces(KNIGHT, c) & KnightAttacks(sq)) ||
+               ((pieces(BISHOP, c) | pieces(QUEEN, c)) & BishopAttacks(sq, bb)) ||
+               ((pieces(ROOK, c) | pieces(QUEEN, c)) & RookAttacks(sq, bb)) || (pieces(KING, c) & KingAttacks(sq));
+    }
 
-    // If the move is a promotion, add the promoted piece to the string stream
-    if (promoted(move))
+    /// @brief plays a legal move on a copy of the position
+    /// @param move
+    /// @return the child position
+    Position play(Move move) const;
+
+  private:
+    void toggle(Piece piece, Square sq)
     {
-        ss << PieceTypeToPromPiece[piece(move)];
+        piecesBB[piece] ^= (1ULL << sq);
+        hashKey ^= RANDOM_ARRAY[64 * hash_piece[piece] + sq];
     }
+};
 
-    return ss.str();
-}
+static_assert(std::is_trivially_copyable<Position>::value, "Position has to be trivially copyable");
 
-/// @brief helper function
-/// @param squareStr
-/// @return
+inline Position Position::play(Move move) const
+{
+    Position next = *this;
+
+    const PieceType pt = piece(move);
+    const Piece p = makePiece(pt, sideToMove);
+    const Square from_sq = from(move);
+    const Square to_sq = to(move);
+    const Piece capture = pieceAt(to_sq);
+
+    assert(p != None);
+    assert(type_of_piece(capture) != KING);
+
+    next.halfMoveClock++;
+    next.fullMoveNumber++;
+
+    if (enPassantSquare != NO_SQ)
+        next.hashKey ^= RANDOM_ARRAY[772 + square_file(enPassantSquare)];
+
+    next.enPassantSquare = NO_SQ;
+
+    next.castlingRights &= CASTLING_MASK[from_sq] & CASTLING_MASK[to_sq];
+    next.hashKey ^= castlingKey[castlingRights] ^ castlingKey[next.castlingRights];
+
+    if (pt == KING)
+    {
+        // castling is encoded as king captures own rook
+        if (capture == makePiece(ROOK, sideToMove))
+        {
+            const Square rookToSq = file_rank_square(to_sq > from_sq ? FILE_F : FILE_D, square_rank(from_sq));
+            const Square kingToSq = file_rank_square(to_sq > from_sq ? FILE_G : FILE_C, square_rank(from_sq));
+
+            next.toggle(p, from_sq);
+            next.toggle(capture, to_sq);
+            next.toggle(p, kingToSq);
+            next.toggle(capture, rookToSq);
+
+            next.hashKey ^= RANDOM_ARRAY[780];
+            next.sideToMove = ~sideToMove;
+            return next;
+        }
+    }
+    else if (pt == PAWN)
+    {
+        next.halfMoveClock = 0;
+        if (to_sq == enPassantSquare)
+        {
+            next.toggle(makePiece(PAWN, ~sideToMove), Square(to_sq ^ 8));
+        }
+        else if (std::abs(from_sq - to_sq) == 16)
+        {
+            const U64 epMask = PawnAttacks(Square(to_sq ^ 8), sideToMove);
+            if (epMask & pieces(PAWN, ~sideToMove))
+            {
+                next.enPassantSquare = Square(to_sq ^ 8);
+                next.hashKey ^= RANDOM_ARRAY[772 + square_file(next.enPassantSquare)];
+            }
+        }
+    }
+
+    if (capture != None)
+    {
+        next.halfMoveClock = 0;
+        next.toggle(capture, to_sq);
+    }
+
+    if (promoted(move))
+    {
+        next.halfMoveClock = 0;
+        next.toggle(makePiece(PAWN, sideToMove), from_sq);
+        next.toggle(p, to_sq);
+    }
+    else
+    {
+        next.toggle(p, from_sq);
+        next.toggle(p, to_sq);
+    }
+
+    next.hashKey ^= RANDOM_ARRAY[780];
+    next.sideToMove = ~sideToMove;
+
+    return next;
+}
+
+/********************
+ * PackedBoard stores a position in 32 bytes for keeping millions of them
+ * in memory (search trees, replay buffers, dedup sets).
+ * The occupancy bitboard is followed by one 4 bit Piece per occupied
+ * square, in square order, so at most 32 pieces fit.
+ * pack() and unpack() work on the bitboards directly, no fen in between.
+ *******************/
+struct PackedBoard
+{
+    U64 occupied = 0;
+
+    // two pieces per byte, the lower nibble comes first
+    uint8_t pieces[16] = {};
+
+    // counts half moves, same as Board::fullMoveNumber
+    uint16_t fullMoveNumber = 2;
+
+    uint8_t halfMoveClock = 0;
+
+    uint8_t castlingRights = 0;
+
+    uint8_t enPassantSquare = NO_SQ;
+
+    uint8_t sideToMove = White;
+
+    /// @brief packs the position of the board, the game history is dropped
+    /// @param board
+    /// @return
+    static PackedBoard pack(const Board &board)
+    {
+        PackedBoard packed;
+        packed.occupied = board.All();
+        packed.fullMoveNumber = board.fullMoveNumber;
+        packed.halfMoveClock = board.halfMoveClock;
+        packed.castlingRights = board.castlingRights;
+        packed.enPassantSquare = board.enPassantSquare;
+        packed.sideToMove = board.sideToMove;
+
+        assert(popcount(packed.occupied) <= 32);
+
+        U64 occ = packed.occupied;
+        for (int i = 0; occ; i++)
+        {
+            const Square sq = poplsb(occ);
+            packed.pieces[i / 2] |= board.board[sq] << (4 * (i & 1));
+        }
+
+        return packed;
+    }
+
+    /// @brief sets up board with the packed position and a new game history
+    /// @param board
+    void unpack(Board &board) const
+    {
+        board.clearPieces();
+
+        U64 occ = occupied;
+        for (int i = 0; occ; i++)
+        {
+            const Square sq = poplsb(occ);
+            board.placePiece(pieceAt(i), sq);
+        }
+
+        board.sideToMove = Color(sideToMove);
+        board.enPassantSquare = Square(enPassantSquare);
+        board.castlingRights = castlingRights;
+        board.halfMoveClock = halfMoveClock;
+        board.fullMoveNumber = fullMoveNumber;
+
+        board.resetHistory();
+    }
+
+    /// @brief zobrist hash of the packed position, equal to Board::hashKey after unpack
+    /// @return
+    U64 hash() const
+    {
+        U64 hash = castlingKey[castlingRights];
+
+        U64 occ = occupied;
+        for (int i = 0; occ; i++)
+        {
+            const Square sq = poplsb(occ);
+            hash ^= RANDOM_ARRAY[64 * hash_piece[pieceAt(i)] + sq];
+        }
+
+        if (enPassantSquare != NO_SQ)
+            hash ^= RANDOM_ARRAY[772 + square_file(Square(enPassantSquare))];
+
+        if (sideToMove == White)
+            hash ^= RANDOM_ARRAY[780];
+
+        return hash;
+    }
+
+    bool operator==(const PackedBoard &other) const
+    {
+        return occupied == other.occupied && std::equal(std::begin(pieces), std::end(pieces), other.pieces) &&
+               fullMoveNumber == other.fullMoveNumber && halfMoveClock == other.halfMoveClock &&
+               castlingRights == other.castlingRights && enPassantSquare == other.enPassantSquare &&
+               sideToMove == other.sideToMove;
+    }
+
+    bool operator!=(const PackedBoard &other) const
+    {
+        return !(*this == other);
+    }
+
+  private:
+    /// @brief the piece of the i-th occupied square
+    /// @param i
+    /// @return
+    Piece pieceAt(int i) const
+    {
+        return Piece((pieces[i / 2] >> (4 * (i & 1))) & 0xF);
+    }
+};
+
+static_assert(sizeof(PackedBoard) <= 32, "PackedBoard has to fit in 32 bytes");
+static_assert(std::is_trivially_copyable<PackedBoard>::value, "PackedBoard has to be trivially copyable");
+
+/********************
+ * Cache for pawn structure evaluation, indexed by Board::pawnKey.
+ * Every distinct pawn structure is evaluated once, as long as it is not
+ * overwritten by another structure that maps to the same slot.
+ * T is whatever the evaluation wants to keep per structure.
+ * Not thread safe, use one table per thread.
+ *******************/
+template <typename T> class PawnHashTable
+{
+  public:
+    explicit PawnHashTable(size_t entries = 1 << 14)
+    {
+        resize(entries);
+    }
+
+    /// @brief sets the size, rounded down to a power of two, and clears the table
+    /// @param entries
+    void resize(size_t entries)
+    {
+        size_t size = 1;
+        while (size * 2 <= std::max<size_t>(entries, 1))
+            size *= 2;
+
+        table.assign(size, Entry());
+        mask = size - 1;
+        hits = 0;
+        misses = 0;
+    }
+
+    void clear()
+    {
+        std::fill(table.begin(), table.end(), Entry());
+        hits = 0;
+        misses = 0;
+    }
+
+    /// @brief the cached value of the pawn structure, compute() is only called on a miss
+    /// @param pawnKey
+    /// @param compute returns the value of the current pawn structure
+    /// @return
+    template <typename F> const T &probe(U64 pawnKey, F &&compute)
+    {
+        Entry &entry = table[pawnKey & mask];
+
+        if (entry.used && entry.key == pawnKey)
+        {
+            hits++;
+            return entry.value;
+        }
+
+        misses++;
+        entry.key = pawnKey;
+        entry.used = true;
+        entry.value = compute();
+        return entry.value;
+    }
+
+    uint64_t hitCount() const
+    {
+        return hits;
+    }
+
+    uint64_t missCount() const
+    {
+        return misses;
+    }
+
+  private:
+    struct Entry
+    {
+        U64 key = 0;
+        T value{};
+        bool used = false;
+    };
+
+    std::vector<Entry> table;
+    size_t mask = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+/// @brief uci representation of a move
+/// @param move
+/// @return
+inline std::string convertMoveToUci(Move move)
+{
+    std::stringstream ss;
+
+    // Get the from and to squares
+    Square from_sq = from(move);
+    Square to_sq = to(move);
+
+    if (piece(move) == KING && square_distance(from_sq, to_sq) > 1) { // castling
+        if (square_file(to_sq) == FILE_A) {
+            to_sq = file_rank_square(FILE_C, square_rank(to_sq));
+        } else if (square_file(to_sq) == FILE_H) {
+            to_sq = file_rank_square(FILE_G, square_rank(to_sq));
+        }
+    }
+
+    // Add the from and to squares to the string stream
+    ss << squareToString[from_sq];
+    ss << squareToString[to_sq];
+
+    // If the move is a promotion, add the promoted piece to the string stream
+    if (promoted(move))
+    {
+        ss << PieceTypeToPromPiece[piece(move)];
+    }
+
+    return ss.str();
+}
+
+/// @brief helper function
+/// @param squareStr
+/// @return
 inline Square extractSquare(std::string_view squareStr)
 {
     char letter = squareStr[0];
@@ -1856,14 +2668,14 @@ template <Color c> U64 pawnRightAttacks(const U64 pawns)
  * Knight and pawns get themselves added to the checkmask, otherwise the path is added.
  * When there is no check at all all bits are set (DEFAULT_CHECKMASK)
  *******************/
-template <Color c> U64 DoCheckmask(Board &board, Square sq)
+template <Color c, typename B> U64 DoCheckmask(B &board, Square sq)
 {
     U64 Occ = board.occAll;
     U64 checks = 0ULL;
-    U64 pawn_mask = board.pieces<PAWN, ~c>() & PawnAttacks(sq, c);
-    U64 knight_mask = board.pieces<KNIGHT, ~c>() & KnightAttacks(sq);
-    U64 bishop_mask = (board.pieces<BISHOP, ~c>() | board.pieces<QUEEN, ~c>()) & BishopAttacks(sq, Occ);
-    U64 rook_mask = (board.pieces<ROOK, ~c>() | board.pieces<QUEEN, ~c>()) & RookAttacks(sq, Occ);
+    U64 pawn_mask = board.pieces(PAWN, ~c) & PawnAttacks(sq, c);
+    U64 knight_mask = board.pieces(KNIGHT, ~c) & KnightAttacks(sq);
+    U64 bishop_mask = (board.pieces(BISHOP, ~c) | board.pieces(QUEEN, ~c)) & BishopAttacks(sq, Occ);
+    U64 rook_mask = (board.pieces(ROOK, ~c) | board.pieces(QUEEN, ~c)) & RookAttacks(sq, Occ);
 
     /********************
      * We keep track of the amount of checks, in case there are
@@ -1886,7 +2698,7 @@ template <Color c> U64 DoCheckmask(Board &board, Square sq)
         int8_t index = lsb(bishop_mask);
 
         // Now we add the path!
-        checks |= board.SQUARES_BETWEEN_BB[sq][index] | (1ULL << index);
+        checks |= SQUARES_BETWEEN_BB[sq][index] | (1ULL << index);
         board.doubleCheck++;
     }
     if (rook_mask)
@@ -1906,7 +2718,7 @@ template <Color c> U64 DoCheckmask(Board &board, Square sq)
         int8_t index = lsb(rook_mask);
 
         // Now we add the path!
-        checks |= board.SQUARES_BETWEEN_BB[sq][index] | (1ULL << index);
+        checks |= SQUARES_BETWEEN_BB[sq][index] | (1ULL << index);
         board.doubleCheck++;
     }
 
@@ -1926,31 +2738,42 @@ template <Color c> U64 DoCheckmask(Board &board, Square sq)
  * the possible pinner. We do this by simply using the popcount
  * of our pieces that lay on the pin mask, if it is only 1 piece then that piece is pinned.
  *******************/
-template <Color c> U64 DoPinMaskRooks(Board &board, Square sq)
+template <Color c, typename B> U64 DoPinMaskRooks(B &board, Square sq)
 {
-    U64 rook_mask = (board.pieces<ROOK, ~c>() | board.pieces<QUEEN, ~c>()) & RookAttacks(sq, board.occEnemy);
+    const U64 sliders = board.pieces(ROOK, ~c) | board.pieces(QUEEN, ~c);
+
+    // pin candidates, without a slider on the rays of the king there is no pin
+    if (!(sliders & (RAYS[0][sq] | RAYS[2][sq] | RAYS[4][sq] | RAYS[6][sq])))
+        return 0ULL;
+
+    U64 rook_mask = sliders & RookAttacks(sq, board.occEnemy);
 
     U64 pinHV = 0ULL;
     while (rook_mask)
     {
         const Square index = poplsb(rook_mask);
-        const U64 possible_pin = (board.SQUARES_BETWEEN_BB[sq][index] | (1ULL << index));
+        const U64 possible_pin = (SQUARES_BETWEEN_BB[sq][index] | (1ULL << index));
         if (popcount(possible_pin & board.occUs) == 1)
             pinHV |= possible_pin;
     }
     return pinHV;
 }
 
-template <Color c> U64 DoPinMaskBishops(Board &board, Square sq)
+template <Color c, typename B> U64 DoPinMaskBishops(B &board, Square sq)
 {
-    U64 bishop_mask = (board.pieces<BISHOP, ~c>() | board.pieces<QUEEN, ~c>()) & BishopAttacks(sq, board.occEnemy);
+    const U64 sliders = board.pieces(BISHOP, ~c) | board.pieces(QUEEN, ~c);
+
+    if (!(sliders & (RAYS[1][sq] | RAYS[3][sq] | RAYS[5][sq] | RAYS[7][sq])))
+        return 0ULL;
+
+    U64 bishop_mask = sliders & BishopAttacks(sq, board.occEnemy);
 
     U64 pinD = 0ULL;
 
     while (bishop_mask)
     {
         const Square index = poplsb(bishop_mask);
-        const U64 possible_pin = (board.SQUARES_BETWEEN_BB[sq][index] | (1ULL << index));
+        const U64 possible_pin = (SQUARES_BETWEEN_BB[sq][index] | (1ULL << index));
         if (popcount(possible_pin & board.occUs) == 1)
             pinD |= possible_pin;
     }
@@ -1963,15 +2786,15 @@ template <Color c> U64 DoPinMaskBishops(Board &board, Square sq)
  * We keep track of all attacked squares by the enemy
  * this is used for king move generation.
  *******************/
-template <Color c> U64 seenSquares(Board &board)
+template <Color c, typename B> U64 seenSquares(B &board)
 {
     const Square kSq = board.KingSQ(~c);
 
-    U64 pawns = board.pieces<PAWN, c>();
-    U64 knights = board.pieces<KNIGHT, c>();
-    U64 queens = board.pieces<QUEEN, c>();
-    U64 bishops = board.pieces<BISHOP, c>() | queens;
-    U64 rooks = board.pieces<ROOK, c>() | queens;
+    U64 pawns = board.pieces(PAWN, c);
+    U64 knights = board.pieces(KNIGHT, c);
+    U64 queens = board.pieces(QUEEN, c);
+    U64 bishops = board.pieces(BISHOP, c) | queens;
+    U64 rooks = board.pieces(ROOK, c) | queens;
 
     // Remove our king
     board.occAll &= ~(1ULL << kSq);
@@ -1983,18 +2806,10 @@ template <Color c> U64 seenSquares(Board &board)
         Square index = poplsb(knights);
         seen |= KnightAttacks(index);
     }
-    while (bishops)
-    {
-        Square index = poplsb(bishops);
-        seen |= BishopAttacks(index, board.occAll);
-    }
-    while (rooks)
-    {
-        Square index = poplsb(rooks);
-        seen |= RookAttacks(index, board.occAll);
-    }
 
-    Square index = lsb(board.pieces<KING, c>());
+    seen |= SliderAttacks(rooks, bishops, board.occAll);
+
+    Square index = lsb(board.pieces(KING, c));
     seen |= KingAttacks(index);
 
     // Place our King back
@@ -2007,17 +2822,23 @@ template <Color c> U64 seenSquares(Board &board)
  * Creates the pinmask and checkmask
  * setup important variables that we use for move generation.
  *******************/
-template <Color c> void init(Board &board, Square sq)
+template <Color c, typename B> void init(B &board, Square sq)
 {
-    board.occUs = board.Us<c>();
-    board.occEnemy = board.Us<~c>();
+    board.occUs = board.Us(c);
+    board.occEnemy = board.Us(~c);
     board.occAll = board.occUs | board.occEnemy;
     board.enemyEmptyBB = ~board.occUs;
 
+    // the masks of this position are still there from an earlier call
+    if (board.movegenValid)
+        return;
+
     board.seen = seenSquares<~c>(board);
     board.checkMask = DoCheckmask<c>(board, sq);
     board.pinHV = DoPinMaskRooks<c>(board, sq);
     board.pinD = DoPinMaskBishops<c>(board, sq);
+
+    board.movegenValid = board.movegenCacheEnabled;
 }
 
 /// @brief shift a mask in a direction
@@ -2049,35 +2870,37 @@ template <Direction direction> constexpr U64 shift(const U64 b)
 
 // all legal moves for each piece
 
-/// @brief all legal pawn moves, generated at once
-/// @tparam c
-/// @tparam mt
-/// @param board
-/// @param movelist
-template <Color c, Movetype mt> void LegalPawnMovesAll(Board &board, Movelist &movelist)
+/// @brief target squares of all pawns, pinned pawns and the checkmask are already applied
+struct PawnTargets
 {
-    const U64 pawns_mask = board.pieces(PAWN, c);
+    // pawns that are not pinned horizontally/vertically, these may capture
+    U64 pawnsLR;
+
+    U64 left;
+    U64 right;
+    U64 singlePush;
+    U64 doublePush;
+};
 
+template <Color c, typename B> PawnTargets LegalPawnTargets(const B &board, U64 pawns_mask)
+{
     constexpr Direction UP = c == White ? NORTH : SOUTH;
-    constexpr Direction DOWN = c == Black ? NORTH : SOUTH;
-    constexpr Direction DOWN_LEFT = c == Black ? NORTH_EAST : SOUTH_WEST;
-    constexpr Direction DOWN_RIGHT = c == Black ? NORTH_WEST : SOUTH_EAST;
-    constexpr U64 RANK_BEFORE_PROMO = c == White ? MASK_RANK[RANK_7] : MASK_RANK[RANK_2];
-    constexpr U64 RANK_PROMO = c == White ? MASK_RANK[RANK_8] : MASK_RANK[RANK_1];
     constexpr U64 doublePushRank = c == White ? MASK_RANK[RANK_3] : MASK_RANK[RANK_6];
 
+    PawnTargets targets;
+
     // These pawns can maybe take Left or Right
-    const U64 pawnsLR = pawns_mask & ~board.pinHV;
+    targets.pawnsLR = pawns_mask & ~board.pinHV;
 
-    const U64 unpinnedpawnsLR = pawnsLR & ~board.pinD;
-    const U64 pinnedpawnsLR = pawnsLR & board.pinD;
+    const U64 unpinnedpawnsLR = targets.pawnsLR & ~board.pinD;
+    const U64 pinnedpawnsLR = targets.pawnsLR & board.pinD;
 
-    U64 Lpawns = (pawnLeftAttacks<c>(unpinnedpawnsLR)) | (pawnLeftAttacks<c>(pinnedpawnsLR) & board.pinD);
-    U64 Rpawns = (pawnRightAttacks<c>(unpinnedpawnsLR)) | (pawnRightAttacks<c>(pinnedpawnsLR) & board.pinD);
+    targets.left = (pawnLeftAttacks<c>(unpinnedpawnsLR)) | (pawnLeftAttacks<c>(pinnedpawnsLR) & board.pinD);
+    targets.right = (pawnRightAttacks<c>(unpinnedpawnsLR)) | (pawnRightAttacks<c>(pinnedpawnsLR) & board.pinD);
 
     // Prune moves that dont capture a piece and are not on the checkmask.
-    Lpawns &= board.occEnemy & board.checkMask;
-    Rpawns &= board.occEnemy & board.checkMask;
+    targets.left &= board.occEnemy & board.checkMask;
+    targets.right &= board.occEnemy & board.checkMask;
 
     // These pawns can walk Forward
     const U64 pawnsHV = pawns_mask & ~board.pinD;
@@ -2090,11 +2913,102 @@ template <Color c, Movetype mt> void LegalPawnMovesAll(Board &board, Movelist &m
     const U64 singlePushPinned = shift<UP>(pawnsPinnedHV) & board.pinHV & ~board.occAll;
 
     // Prune moves that are not on the checkmask.
-    U64 singlePush = (singlePushUnpinned | singlePushPinned) & board.checkMask;
+    targets.singlePush = (singlePushUnpinned | singlePushPinned) & board.checkMask;
 
-    U64 doublePush = ((shift<UP>(singlePushUnpinned & doublePushRank) & ~board.occAll) |
-                      (shift<UP>(singlePushPinned & doublePushRank) & ~board.occAll)) &
-                     board.checkMask;
+    targets.doublePush = ((shift<UP>(singlePushUnpinned & doublePushRank) & ~board.occAll) |
+                          (shift<UP>(singlePushPinned & doublePushRank) & ~board.occAll)) &
+                         board.checkMask;
+
+    return targets;
+}
+
+/// @brief pawns that can legally capture en passant
+/// @tparam c
+/// @param board
+/// @param pawnsLR pawns that are not pinned horizontally/vertically
+/// @return bitboard of the capturing pawns
+template <Color c, typename B> U64 LegalEpPawns(const B &board, U64 pawnsLR)
+{
+    constexpr Direction DOWN = c == Black ? NORTH : SOUTH;
+
+    if (board.enPassantSquare == NO_SQ)
+        return 0ULL;
+
+    const Square ep = board.enPassantSquare;
+    const Square epPawn = ep + DOWN;
+
+    U64 epMask = (1ull << epPawn) | (1ull << ep);
+
+    /********************
+     * In case the en passant square and the enemy pawn
+     * that just moved are not on the checkmask
+     * en passant is not available.
+     *******************/
+    if ((board.checkMask & epMask) == 0)
+        return 0ULL;
+
+    const Square kSQ = board.KingSQ(c);
+    const U64 kingMask = (1ull << kSQ) & MASK_RANK[square_rank(epPawn)];
+    const U64 enemyQueenRook = board.pieces(ROOK, ~c) | board.pieces(QUEEN, ~c);
+
+    const bool isPossiblePin = kingMask && enemyQueenRook;
+    U64 epBB = PawnAttacks(ep, ~c) & pawnsLR;
+    U64 legal = 0ULL;
+
+    /********************
+     * For one en passant square two pawns could potentially take there.
+     *******************/
+    while (epBB)
+    {
+        Square from = poplsb(epBB);
+
+        /********************
+         * If the pawn is pinned but the en passant square is not on the
+         * pin mask then the move is illegal.
+         *******************/
+        if ((1ULL << from) & board.pinD && !(board.pinD & (1ull << ep)))
+            continue;
+
+        const U64 connectingPawns = (1ull << epPawn) | (1ull << from);
+
+        /********************
+         * 7k/4p3/8/2KP3r/8/8/8/8 b - - 0 1
+         * If e7e5 there will be a potential ep square for us on e6.
+         * However we cannot take en passant because that would put our king
+         * in check. For this scenario we check if theres an enemy rook/queen
+         * that would give check if the two pawns were removed.
+         * If thats the case then the move is illegal and we can break immediately.
+         *******************/
+        if (isPossiblePin && (RookAttacks(kSQ, board.occAll & ~connectingPawns) & enemyQueenRook) != 0)
+            break;
+
+        legal |= 1ULL << from;
+    }
+
+    return legal;
+}
+
+/// @brief all legal pawn moves, generated at once
+/// @tparam c
+/// @tparam mt
+/// @param board
+/// @param movelist
+template <Color c, Movetype mt, typename B> void LegalPawnMovesAll(B &board, Movelist &movelist)
+{
+    const U64 pawns_mask = board.pieces(PAWN, c);
+
+    constexpr Direction DOWN = c == Black ? NORTH : SOUTH;
+    constexpr Direction DOWN_LEFT = c == Black ? NORTH_EAST : SOUTH_WEST;
+    constexpr Direction DOWN_RIGHT = c == Black ? NORTH_WEST : SOUTH_EAST;
+    constexpr U64 RANK_BEFORE_PROMO = c == White ? MASK_RANK[RANK_7] : MASK_RANK[RANK_2];
+    constexpr U64 RANK_PROMO = c == White ? MASK_RANK[RANK_8] : MASK_RANK[RANK_1];
+
+    const PawnTargets targets = LegalPawnTargets<c>(board, pawns_mask);
+
+    U64 Lpawns = targets.left;
+    U64 Rpawns = targets.right;
+    U64 singlePush = targets.singlePush;
+    U64 doublePush = targets.doublePush;
 
     /********************
      * Add promotion moves.
@@ -2178,67 +3092,51 @@ template <Color c, Movetype mt> void LegalPawnMovesAll(Board &board, Movelist &m
     /********************
      * Add en passant captures.
      *******************/
-    if (mt != Movetype::QUIET && board.enPassantSquare != NO_SQ)
+    if (mt != Movetype::QUIET)
     {
-        const Square ep = board.enPassantSquare;
-        const Square epPawn = ep + DOWN;
-
-        U64 epMask = (1ull << epPawn) | (1ull << ep);
-
-        /********************
-         * In case the en passant square and the enemy pawn
-         * that just moved are not on the checkmask
-         * en passant is not available.
-         *******************/
-        if ((board.checkMask & epMask) == 0)
-            return;
-
-        const Square kSQ = board.KingSQ(c);
-        const U64 kingMask = (1ull << kSQ) & MASK_RANK[square_rank(epPawn)];
-        const U64 enemyQueenRook = board.pieces(ROOK, ~c) | board.pieces(QUEEN, ~c);
-
-        const bool isPossiblePin = kingMask && enemyQueenRook;
-        U64 epBB = PawnAttacks(ep, ~c) & pawnsLR;
-
-        /********************
-         * For one en passant square two pawns could potentially take there.
-         *******************/
+        U64 epBB = LegalEpPawns<c>(board, targets.pawnsLR);
         while (epBB)
         {
             Square from = poplsb(epBB);
-            Square to = ep;
-
-            /********************
-             * If the pawn is pinned but the en passant square is not on the
-             * pin mask then the move is illegal.
-             *******************/
-            if ((1ULL << from) & board.pinD && !(board.pinD & (1ull << ep)))
-                continue;
-
-            const U64 connectingPawns = (1ull << epPawn) | (1ull << from);
-
-            /********************
-             * 7k/4p3/8/2KP3r/8/8/8/8 b - - 0 1
-             * If e7e5 there will be a potential ep square for us on e6.
-             * However we cannot take en passant because that would put our king
-             * in check. For this scenario we check if theres an enemy rook/queen
-             * that would give check if the two pawns were removed.
-             * If thats the case then the move is illegal and we can break immediately.
-             *******************/
-            if (isPossiblePin && (RookAttacks(kSQ, board.occAll & ~connectingPawns) & enemyQueenRook) != 0)
-                break;
-
-            movelist.Add(make<PAWN, false>(from, to));
+            movelist.Add(make<PAWN, false>(from, board.enPassantSquare));
         }
     }
 }
 
-inline U64 LegalKnightMoves(Square sq, U64 movableSquare)
+/// @brief counts the legal pawn moves, promotions count four times
+/// @tparam c
+/// @tparam mt
+/// @param board
+/// @return
+template <Color c, Movetype mt, typename B> int CountPawnMoves(const B &board)
 {
-    return KnightAttacks(sq) & movableSquare;
+    const U64 pawns_mask = board.pieces(PAWN, c);
+
+    constexpr U64 RANK_PROMO = c == White ? MASK_RANK[RANK_8] : MASK_RANK[RANK_1];
+
+    const PawnTargets targets = LegalPawnTargets<c>(board, pawns_mask);
+    int count = 0;
+
+    if (mt != Movetype::QUIET)
+    {
+        count += 4 * (popcount(targets.left & RANK_PROMO) + popcount(targets.right & RANK_PROMO) +
+                      popcount(targets.singlePush & RANK_PROMO));
+        count += popcount(targets.left & ~RANK_PROMO) + popcount(targets.right & ~RANK_PROMO);
+        count += popcount(LegalEpPawns<c>(board, targets.pawnsLR));
+    }
+
+    if (mt != Movetype::CAPTURE)
+        count += popcount(targets.singlePush & ~RANK_PROMO) + popcount(targets.doublePush);
+
+    return count;
+}
+
+inline U64 LegalKnightMoves(Square sq, U64 movableSquare)
+{
+    return KnightAttacks(sq) & movableSquare;
 }
 
-inline U64 LegalBishopMoves(const Board &board, Square sq, U64 movableSquare)
+template <typename B> U64 LegalBishopMoves(const B &board, Square sq, U64 movableSquare)
 {
     // The Bishop is pinned diagonally thus can only move diagonally.
     if (board.pinD & (1ULL << sq))
@@ -2246,7 +3144,7 @@ inline U64 LegalBishopMoves(const Board &board, Square sq, U64 movableSquare)
     return BishopAttacks(sq, board.occAll) & movableSquare;
 }
 
-inline U64 LegalRookMoves(const Board &board, Square sq, U64 movableSquare)
+template <typename B> U64 LegalRookMoves(const B &board, Square sq, U64 movableSquare)
 {
     // The Rook is pinned horizontally thus can only move horizontally.
     if (board.pinHV & (1ULL << sq))
@@ -2254,7 +3152,7 @@ inline U64 LegalRookMoves(const Board &board, Square sq, U64 movableSquare)
     return RookAttacks(sq, board.occAll) & movableSquare;
 }
 
-inline U64 LegalQueenMoves(const Board &board, Square sq, U64 movableSquare)
+template <typename B> U64 LegalQueenMoves(const B &board, Square sq, U64 movableSquare)
 {
     U64 moves = 0ULL;
 
@@ -2271,7 +3169,7 @@ inline U64 LegalQueenMoves(const Board &board, Square sq, U64 movableSquare)
     return moves;
 }
 
-template <Movetype mt> U64 LegalKingMoves(const Board &board, Square sq)
+template <Movetype mt, typename B> U64 LegalKingMoves(const B &board, Square sq)
 {
     U64 bb;
 
@@ -2285,7 +3183,7 @@ template <Movetype mt> U64 LegalKingMoves(const Board &board, Square sq)
     return KingAttacks(sq) & bb & ~board.seen;
 }
 
-template <Color c, Movetype mt> U64 LegalKingMovesCastling(const Board &board, Square sq)
+template <Color c, Movetype mt, typename B> U64 LegalKingMovesCastling(const B &board, Square sq)
 {
     U64 bb;
 
@@ -2330,13 +3228,245 @@ template <Color c, Movetype mt> U64 LegalKingMovesCastling(const Board &board, S
     return moves;
 }
 
+/********************
+ * Evasions, all legal moves when we are in check.
+ * A pinned piece can never capture the checker or block the check,
+ * its pin ray and the check ray only meet on our king.
+ * Thus pinned pieces are skipped entirely and the others
+ * dont need any pin handling, castling is never possible.
+ *******************/
+template <Color c, typename B> void LegalEvasions(B &board, Movelist &movelist)
+{
+    const Square kSq = board.KingSQ(c);
+
+    U64 moves = LegalKingMoves<Movetype::ALL>(board, kSq);
+    while (moves)
+    {
+        Square to = poplsb(moves);
+        movelist.Add(make<KING, false>(kSq, to));
+    }
+
+    if (board.doubleCheck == 2)
+        return;
+
+    const U64 movableSquare = board.checkMask & board.enemyEmptyBB;
+    const U64 unpinned = ~(board.pinD | board.pinHV);
+
+    U64 knights_mask = board.pieces(KNIGHT, c) & unpinned;
+    U64 bishops_mask = board.pieces(BISHOP, c) & unpinned;
+    U64 rooks_mask = board.pieces(ROOK, c) & unpinned;
+    U64 queens_mask = board.pieces(QUEEN, c) & unpinned;
+
+    // pinned pawns are already handled by the pawn generator
+    LegalPawnMovesAll<c, Movetype::ALL>(board, movelist);
+
+    while (knights_mask)
+    {
+        Square from = poplsb(knights_mask);
+        U64 moves = KnightAttacks(from) & movableSquare;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<KNIGHT, false>(from, to));
+        }
+    }
+
+    while (bishops_mask)
+    {
+        Square from = poplsb(bishops_mask);
+        U64 moves = BishopAttacks(from, board.occAll) & movableSquare;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<BISHOP, false>(from, to));
+        }
+    }
+
+    while (rooks_mask)
+    {
+        Square from = poplsb(rooks_mask);
+        U64 moves = RookAttacks(from, board.occAll) & movableSquare;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<ROOK, false>(from, to));
+        }
+    }
+
+    while (queens_mask)
+    {
+        Square from = poplsb(queens_mask);
+        U64 moves = QueenAttacks(from, board.occAll) & movableSquare;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<QUEEN, false>(from, to));
+        }
+    }
+}
+
+/********************
+ * Discovered check candidates.
+ * Our pieces that are the only blocker between one of our sliders
+ * and the enemy king, same idea as the pinmask but for the enemy king.
+ *******************/
+template <Color c, typename B> U64 DiscoveredCheckCandidates(const B &board, Square kSq)
+{
+    const U64 rooks = board.pieces(ROOK, c) | board.pieces(QUEEN, c);
+    const U64 bishops = board.pieces(BISHOP, c) | board.pieces(QUEEN, c);
+
+    U64 snipers = (rooks & RookAttacks(kSq, board.occEnemy)) | (bishops & BishopAttacks(kSq, board.occEnemy));
+    U64 candidates = 0ULL;
+
+    while (snipers)
+    {
+        const Square index = poplsb(snipers);
+        const U64 blockers = SQUARES_BETWEEN_BB[kSq][index] & board.occAll;
+        if (popcount(blockers) == 1)
+            candidates |= blockers & board.occUs;
+    }
+
+    return candidates;
+}
+
+/********************
+ * Quiet checks, quiet moves that attack the enemy king.
+ * A move gives a direct check when it lands on a check square of its piece,
+ * the squares the piece would attack the enemy king from.
+ * A discovered check candidate gives check with every move that leaves
+ * its line through the enemy king.
+ * Castling and promotions are not included, promotions come with the captures.
+ *******************/
+template <Color c, typename B> void LegalQuietChecks(B &board, Movelist &movelist)
+{
+    constexpr Direction UP = c == White ? NORTH : SOUTH;
+    constexpr Direction DOWN = c == Black ? NORTH : SOUTH;
+    constexpr U64 RANK_PROMO = c == White ? MASK_RANK[RANK_8] : MASK_RANK[RANK_1];
+
+    const Square kSq = board.KingSQ(c);
+    const Square enemyKSq = board.KingSQ(~c);
+    const U64 discovered = DiscoveredCheckCandidates<c>(board, enemyKSq);
+
+    // our king can only give a discovered check
+    if (discovered & (1ULL << kSq))
+    {
+        U64 moves = LegalKingMoves<Movetype::QUIET>(board, kSq) & ~LINE_BB[enemyKSq][kSq];
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<KING, false>(kSq, to));
+        }
+    }
+
+    if (board.doubleCheck == 2)
+        return;
+
+    const U64 movableSquare = board.checkMask & ~board.occAll;
+
+    const U64 bishopChecks = BishopAttacks(enemyKSq, board.occAll);
+    const U64 rookChecks = RookAttacks(enemyKSq, board.occAll);
+    const U64 knightChecks = KnightAttacks(enemyKSq);
+
+    /********************
+     * Pawn pushes, a pushed candidate only stays on the
+     * line when it stands on the file of the enemy king.
+     *******************/
+    const PawnTargets targets = LegalPawnTargets<c>(board, board.pieces(PAWN, c));
+    const U64 pawnChecks = PawnAttacks(enemyKSq, ~c);
+    const U64 discoveredPawns = discovered & board.pieces(PAWN, c) & ~MASK_FILE[square_file(enemyKSq)];
+
+    U64 singlePush = targets.singlePush & ~RANK_PROMO & (pawnChecks | shift<UP>(discoveredPawns));
+    U64 doublePush = targets.doublePush & (pawnChecks | shift<UP>(shift<UP>(discoveredPawns)));
+
+    while (singlePush)
+    {
+        Square to = poplsb(singlePush);
+        movelist.Add(make<PAWN, false>(to + DOWN, to));
+    }
+
+    while (doublePush)
+    {
+        Square to = poplsb(doublePush);
+        movelist.Add(make<PAWN, false>(to + DOWN + DOWN, to));
+    }
+
+    U64 knights_mask = board.pieces(KNIGHT, c) & ~(board.pinD | board.pinHV);
+    U64 bishops_mask = board.pieces(BISHOP, c) & ~board.pinHV;
+    U64 rooks_mask = board.pieces(ROOK, c) & ~board.pinD;
+    U64 queens_mask = board.pieces(QUEEN, c) & ~(board.pinD & board.pinHV);
+
+    while (knights_mask)
+    {
+        Square from = poplsb(knights_mask);
+        U64 moves = LegalKnightMoves(from, movableSquare);
+        if (!(discovered & (1ULL << from)))
+            moves &= knightChecks;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<KNIGHT, false>(from, to));
+        }
+    }
+
+    while (bishops_mask)
+    {
+        Square from = poplsb(bishops_mask);
+        U64 checks = bishopChecks;
+        if (discovered & (1ULL << from))
+            checks |= ~LINE_BB[enemyKSq][from];
+        U64 moves = LegalBishopMoves(board, from, movableSquare) & checks;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<BISHOP, false>(from, to));
+        }
+    }
+
+    while (rooks_mask)
+    {
+        Square from = poplsb(rooks_mask);
+        U64 checks = rookChecks;
+        if (discovered & (1ULL << from))
+            checks |= ~LINE_BB[enemyKSq][from];
+        U64 moves = LegalRookMoves(board, from, movableSquare) & checks;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<ROOK, false>(from, to));
+        }
+    }
+
+    while (queens_mask)
+    {
+        Square from = poplsb(queens_mask);
+        U64 checks = bishopChecks | rookChecks;
+        if (discovered & (1ULL << from))
+            checks |= ~LINE_BB[enemyKSq][from];
+        U64 moves = LegalQueenMoves(board, from, movableSquare) & checks;
+        while (moves)
+        {
+            Square to = poplsb(moves);
+            movelist.Add(make<QUEEN, false>(from, to));
+        }
+    }
+}
+
 // all legal moves for a position
-template <Color c, Movetype mt> void legalmoves(Board &board, Movelist &movelist)
+template <Color c, Movetype mt, typename B> void legalmoves(B &board, Movelist &movelist)
 {
     init<c>(board, board.KingSQ(c));
 
     assert(board.doubleCheck <= 2);
 
+    if (mt == Movetype::QUIET_CHECKS)
+        return LegalQuietChecks<c>(board, movelist);
+
+    if (mt == Movetype::EVASIONS && board.checkMask != DEFAULT_CHECKMASK)
+        return LegalEvasions<c>(board, movelist);
+
+    // outside of check the evasions are all moves
+    constexpr Movetype gen = mt == Movetype::EVASIONS ? Movetype::ALL : mt;
+
     /********************
      * Moves have to be on the checkmask
      *******************/
@@ -2345,9 +3475,9 @@ template <Color c, Movetype mt> void legalmoves(Board &board, Movelist &movelist
     /********************
      * Slider, Knights and King moves can only go to enemy or empty squares.
      *******************/
-    if (mt == Movetype::ALL)
+    if (gen == Movetype::ALL)
         movableSquare &= board.enemyEmptyBB;
-    else if (mt == Movetype::CAPTURE)
+    else if (gen == Movetype::CAPTURE)
         movableSquare &= board.occEnemy;
     else // QUIET moves
         movableSquare &= ~board.occAll;
@@ -2355,10 +3485,10 @@ template <Color c, Movetype mt> void legalmoves(Board &board, Movelist &movelist
     Square from = board.KingSQ(c);
     U64 moves;
 
-    if (mt == Movetype::CAPTURE || !board.castlingRights || board.checkMask != DEFAULT_CHECKMASK)
-        moves = LegalKingMoves<mt>(board, from);
+    if (gen == Movetype::CAPTURE || !board.castlingRights || board.checkMask != DEFAULT_CHECKMASK)
+        moves = LegalKingMoves<gen>(board, from);
     else
-        moves = LegalKingMovesCastling<c, mt>(board, from);
+        moves = LegalKingMovesCastling<c, gen>(board, from);
 
     while (moves)
     {
@@ -2395,7 +3525,7 @@ template <Color c, Movetype mt> void legalmoves(Board &board, Movelist &movelist
     /********************
      * Add the moves to the movelist.
      *******************/
-    LegalPawnMovesAll<c, mt>(board, movelist);
+    LegalPawnMovesAll<c, gen>(board, movelist);
 
     while (knights_mask)
     {
@@ -2442,6 +3572,109 @@ template <Color c, Movetype mt> void legalmoves(Board &board, Movelist &movelist
     }
 }
 
+/********************
+ * Counts the legal moves without writing them to a movelist.
+ * Uses the same masks as legalmoves, the destinations are counted with popcount.
+ *******************/
+template <Color c, Movetype mt, typename B> int countLegalMoves(B &board)
+{
+    static_assert(mt == Movetype::ALL || mt == Movetype::CAPTURE || mt == Movetype::QUIET,
+                  "only ALL, CAPTURE and QUIET moves can be counted");
+
+    init<c>(board, board.KingSQ(c));
+
+    assert(board.doubleCheck <= 2);
+
+    U64 movableSquare = board.checkMask;
+
+    if (mt == Movetype::ALL)
+        movableSquare &= board.enemyEmptyBB;
+    else if (mt == Movetype::CAPTURE)
+        movableSquare &= board.occEnemy;
+    else // QUIET moves
+        movableSquare &= ~board.occAll;
+
+    const Square kSq = board.KingSQ(c);
+    int count;
+
+    if (mt == Movetype::CAPTURE || !board.castlingRights || board.checkMask != DEFAULT_CHECKMASK)
+        count = popcount(LegalKingMoves<mt>(board, kSq));
+    else
+        count = popcount(LegalKingMovesCastling<c, mt>(board, kSq));
+
+    if (board.doubleCheck == 2)
+        return count;
+
+    U64 knights_mask = board.pieces(KNIGHT, c) & ~(board.pinD | board.pinHV);
+    U64 bishops_mask = board.pieces(BISHOP, c) & ~board.pinHV;
+    U64 rooks_mask = board.pieces(ROOK, c) & ~board.pinD;
+    U64 queens_mask = board.pieces(QUEEN, c) & ~(board.pinD & board.pinHV);
+
+    count += CountPawnMoves<c, mt>(board);
+
+    while (knights_mask)
+        count += popcount(LegalKnightMoves(poplsb(knights_mask), movableSquare));
+
+    while (bishops_mask)
+        count += popcount(LegalBishopMoves(board, poplsb(bishops_mask), movableSquare));
+
+    while (rooks_mask)
+        count += popcount(LegalRookMoves(board, poplsb(rooks_mask), movableSquare));
+
+    while (queens_mask)
+        count += popcount(LegalQueenMoves(board, poplsb(queens_mask), movableSquare));
+
+    return count;
+}
+
+/********************
+ * Movegen stores its masks on the board it works on.
+ * A Position has no room for them, so they live in this
+ * wrapper for the duration of one call.
+ *******************/
+struct PositionMovegen
+{
+    const Position &pos;
+
+    const uint8_t &castlingRights;
+    const Square &enPassantSquare;
+
+    uint8_t doubleCheck = 0;
+    U64 pinHV = 0;
+    U64 pinD = 0;
+    U64 checkMask = DEFAULT_CHECKMASK;
+    U64 seen = 0;
+
+    U64 occEnemy = 0;
+    U64 occUs = 0;
+    U64 occAll = 0;
+    U64 enemyEmptyBB = 0;
+
+    // the wrapper only lives for one call, nothing to cache
+    static constexpr bool movegenCacheEnabled = false;
+    bool movegenValid = false;
+
+    explicit PositionMovegen(const Position &position)
+        : pos(position), castlingRights(position.castlingRights), enPassantSquare(position.enPassantSquare)
+    {
+    }
+
+    constexpr U64 pieces(PieceType p, Color c) const
+    {
+        return pos.pieces(p, c);
+    }
+
+    U64 Us(Color c) const
+    {
+        return pos.Us(c);
+    }
+
+    Square KingSQ(Color c) const
+    {
+        return pos.KingSQ(c);
+    }
+};
+
 /********************
  * Entry function for the
  * Color template.
@@ -2454,4 +3687,464 @@ template <Movetype mt> void legalmoves(Board &board, Movelist &movelist, int sta
     else
         legalmoves<Black, mt>(board, movelist);
 }
+
+template <Movetype mt> void legalmoves(const Position &pos, Movelist &movelist, int start_index = 0)
+{
+    PositionMovegen board(pos);
+
+    movelist.size = start_index;
+    if (pos.sideToMove == White)
+        legalmoves<White, mt>(board, movelist);
+    else
+        legalmoves<Black, mt>(board, movelist);
+}
+
+/// @brief number of legal moves, same result as legalmoves<mt>(...).size
+template <Movetype mt> int countLegalMoves(Board &board)
+{
+    if (board.sideToMove == White)
+        return countLegalMoves<White, mt>(board);
+    else
+        return countLegalMoves<Black, mt>(board);
+}
+
+template <Movetype mt> int countLegalMoves(const Position &pos)
+{
+    PositionMovegen board(pos);
+
+    if (pos.sideToMove == White)
+        return countLegalMoves<White, mt>(board);
+    else
+        return countLegalMoves<Black, mt>(board);
+}
+
+/********************
+ * Checks a move that did not come from the movegen of this position,
+ * for example a hash move or a killer move.
+ * Only the moving piece is looked at, pawns go through their own generator.
+ *******************/
+template <Color c, typename B> bool isLegal(B &board, Move move)
+{
+    const Square from_sq = from(move);
+    const Square to_sq = to(move);
+    const PieceType pt = promoted(move) ? PAWN : piece(move);
+
+    if (from_sq == to_sq || pt == NONETYPE || !(board.pieces(pt, c) & (1ULL << from_sq)))
+        return false;
+
+    init<c>(board, board.KingSQ(c));
+
+    const U64 toBB = 1ULL << to_sq;
+
+    if (pt == KING)
+    {
+        if (!board.castlingRights || board.checkMask != DEFAULT_CHECKMASK)
+            return LegalKingMoves<ALL>(board, from_sq) & toBB;
+        return LegalKingMovesCastling<c, ALL>(board, from_sq) & toBB;
+    }
+
+    if (board.doubleCheck == 2)
+        return false;
+
+    const U64 movableSquare = board.checkMask & board.enemyEmptyBB;
+    const U64 fromBB = 1ULL << from_sq;
+
+    switch (pt)
+    {
+    case PAWN: {
+        Movelist moves;
+        LegalPawnMovesAll<c, ALL>(board, moves);
+        return moves.find(move) != -1;
+    }
+    case KNIGHT:
+        return !(fromBB & (board.pinD | board.pinHV)) && (LegalKnightMoves(from_sq, movableSquare) & toBB);
+    case BISHOP:
+        return !(fromBB & board.pinHV) && (LegalBishopMoves(board, from_sq, movableSquare) & toBB);
+    case ROOK:
+        return !(fromBB & board.pinD) && (LegalRookMoves(board, from_sq, movableSquare) & toBB);
+    case QUEEN:
+        return !(fromBB & board.pinD & board.pinHV) && (LegalQueenMoves(board, from_sq, movableSquare) & toBB);
+    default:
+        return false;
+    }
+}
+
+template <typename B> bool isLegal(B &board, Move move)
+{
+    if (board.sideToMove == White)
+        return isLegal<White>(board, move);
+    else
+        return isLegal<Black>(board, move);
+}
+
+/********************
+ * Staged move picker for search.
+ * Yields the hash move, then the captures (MVV-LVA), then the killers
+ * and finally the quiet moves. A stage is only generated once the previous
+ * one is used up, so a cutoff on an early move never pays for the quiets.
+ * Moves that were already yielded in an earlier stage are skipped.
+ *******************/
+class MovePicker
+{
+  public:
+    enum Stage : uint8_t
+    {
+        HASH_MOVE,
+        GEN_CAPTURES,
+        CAPTURES,
+        KILLERS,
+        GEN_QUIETS,
+        QUIETS,
+        DONE
+    };
+
+    MovePicker(Board &board, Move hashMove = NO_MOVE, Move killer1 = NO_MOVE, Move killer2 = NO_MOVE)
+        : board(board), hashMove(hashMove), killers{killer1, killer2 != killer1 ? killer2 : NO_MOVE}
+    {
+    }
+
+    /// @brief the next legal move
+    /// @return NO_MOVE once all moves are exhausted
+    Move next()
+    {
+        switch (stage)
+        {
+        case HASH_MOVE:
+            stage = GEN_CAPTURES;
+            if (hashMove != NO_MOVE && isLegal(board, hashMove))
+                return hashMove;
+            [[fallthrough]];
+
+        case GEN_CAPTURES:
+            legalmoves<CAPTURE>(board, moves);
+            generated += moves.size;
+            scoreCaptures();
+            index = 0;
+            stage = CAPTURES;
+            [[fallthrough]];
+
+        case CAPTURES:
+            while (index < moves.size)
+            {
+                const Move move = pickBest();
+                if (move != hashMove)
+                    return move;
+            }
+            stage = KILLERS;
+            index = 0;
+            [[fallthrough]];
+
+        case KILLERS:
+            while (index < 2)
+            {
+                const Move killer = killers[index++];
+                if (killer != NO_MOVE && killer != hashMove && isQuiet(killer) && isLegal(board, killer))
+                    return killer;
+            }
+            stage = GEN_QUIETS;
+            [[fallthrough]];
+
+        case GEN_QUIETS:
+            legalmoves<QUIET>(board, moves);
+            generated += moves.size;
+            index = 0;
+            stage = QUIETS;
+            [[fallthrough]];
+
+        case QUIETS:
+            while (index < moves.size)
+            {
+                const Move move = moves[index++].move;
+                if (move != hashMove && move != killers[0] && move != killers[1])
+                    return move;
+            }
+            stage = DONE;
+            [[fallthrough]];
+
+        case DONE:
+            return NO_MOVE;
+        }
+
+        return NO_MOVE;
+    }
+
+    Stage currentStage() const
+    {
+        return stage;
+    }
+
+    /// @brief number of moves written to movelists so far
+    int generatedMoves() const
+    {
+        return generated;
+    }
+
+  private:
+    Board &board;
+    Movelist moves;
+    Move hashMove;
+    Move killers[2];
+    Stage stage = HASH_MOVE;
+    int index = 0;
+    int generated = 0;
+
+    // a killer is only tried when it would not come with the captures
+    bool isQuiet(Move move) const
+    {
+        const Piece target = board.pieceAtB(to(move));
+        return !promoted(move) && (target == None || board.colorOf(to(move)) == board.sideToMove) &&
+               !(piece(move) == PAWN && to(move) == board.enPassantSquare);
+    }
+
+    void scoreCaptures()
+    {
+        static constexpr int VALUE[7] = {1, 3, 3, 5, 9, 0, 0};
+
+        for (auto &ext : moves)
+        {
+            const PieceType victim = board.pieceTypeAtB(to(ext.move));
+            const PieceType attacker = promoted(ext.move) ? PAWN : piece(ext.move);
+            ext.value = 16 * VALUE[victim == NONETYPE && attacker == PAWN && !promoted(ext.move) ? PAWN : victim] -
+                        VALUE[attacker];
+            if (promoted(ext.move))
+                ext.value += 16 * VALUE[piece(ext.move)];
+        }
+    }
+
+    Move pickBest()
+    {
+        int best = index;
+        for (int i = index + 1; i < moves.size; i++)
+        {
+            if (moves[i] > moves[best])
+                best = i;
+        }
+        std::swap(moves[index], moves[best]);
+        return moves[index++].move;
+    }
+};
 } // namespace Movegen
+
+namespace Chess
+{
+
+/// @brief the piece type of a SAN piece letter
+/// @param c
+/// @return NONETYPE for anything else
+inline constexpr PieceType sanPieceType(char c)
+{
+    switch (c)
+    {
+    case 'N':
+        return KNIGHT;
+    case 'B':
+        return BISHOP;
+    case 'R':
+        return ROOK;
+    case 'Q':
+        return QUEEN;
+    case 'K':
+        return KING;
+    default:
+        return NONETYPE;
+    }
+}
+
+/********************
+ * Writes the SAN of a legal move to out, without a null terminator.
+ * Other pieces that reach the target square are found with attack
+ * bitboards, only those are checked for legality to disambiguate.
+ * The check suffix needs a make/unmake, mate is only tested after a check.
+ * Returns the number of chars written, at most MAX_SAN_LENGTH.
+ *******************/
+inline int moveToSan(Board &board, Move move, char *out)
+{
+    static constexpr char PIECE_LETTERS[] = "PNBRQK";
+
+    char *san = out;
+    const Color c = board.sideToMove;
+    const Square from_sq = from(move);
+    const Square to_sq = to(move);
+    const PieceType pt = board.pieceTypeAtB(from_sq);
+
+    if (pt == KING && board.pieceAtB(to_sq) == makePiece(ROOK, c))
+    {
+        *san++ = 'O';
+        *san++ = '-';
+        *san++ = 'O';
+        if (to_sq < from_sq)
+        {
+            *san++ = '-';
+            *san++ = 'O';
+        }
+    }
+    else
+    {
+        const bool capture = board.pieceAtB(to_sq) != None || (pt == PAWN && to_sq == board.enPassantSquare);
+
+        if (pt == PAWN)
+        {
+            if (capture)
+                *san++ = char('a' + square_file(from_sq));
+        }
+        else
+        {
+            *san++ = PIECE_LETTERS[pt];
+
+            // other pieces of the same type that can legally reach the square
+            U64 others = board.attacksByPiece(pt, to_sq, c) & board.pieces(pt, c) & ~(1ULL << from_sq);
+            bool ambiguous = false, sameFile = false, sameRank = false;
+
+            while (others)
+            {
+                const Square other = poplsb(others);
+                if (!Movegen::isLegal(board, make(pt, other, to_sq)))
+                    continue;
+
+                ambiguous = true;
+                sameFile |= square_file(other) == square_file(from_sq);
+                sameRank |= square_rank(other) == square_rank(from_sq);
+            }
+
+            if (ambiguous && (!sameFile || sameRank))
+                *san++ = char('a' + square_file(from_sq));
+            if (ambiguous && sameFile)
+                *san++ = char('1' + square_rank(from_sq));
+        }
+
+        if (capture)
+            *san++ = 'x';
+
+        *san++ = char('a' + square_file(to_sq));
+        *san++ = char('1' + square_rank(to_sq));
+
+        if (promoted(move))
+        {
+            *san++ = '=';
+            *san++ = PIECE_LETTERS[piece(move)];
+        }
+    }
+
+    board.makeMove(move);
+    if (board.isSquareAttacked(c, board.KingSQ(~c)))
+        *san++ = Movegen::countLegalMoves<ALL>(board) ? '+' : '#';
+    board.unmakeMove(move);
+
+    return int(san - out);
+}
+
+/// @brief SAN of a legal move as a string
+/// @param board
+/// @param move
+/// @return
+inline std::string moveToSan(Board &board, Move move)
+{
+    char buffer[MAX_SAN_LENGTH];
+    return std::string(buffer, moveToSan(board, move, buffer));
+}
+
+/********************
+ * Finds the legal move of a SAN move. The candidates are the pieces
+ * of the moving type that attack the target square (pawns: the squares
+ * they push from), narrowed by the disambiguation and checked for legality.
+ * Check, mate and annotation suffixes are ignored.
+ * Returns NO_MOVE if no legal move or more than one matches.
+ *******************/
+inline Move sanToMove(Board &board, std::string_view san)
+{
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?'))
+        san.remove_suffix(1);
+
+    const Color c = board.sideToMove;
+
+    if (san == "O-O" || san == "O-O-O" || san == "0-0" || san == "0-0-0")
+    {
+        const Square kingSq = board.KingSQ(c);
+        const Move move = make(KING, kingSq, file_rank_square(san.size() == 3 ? FILE_H : FILE_A, square_rank(kingSq)));
+        return board.pieceAtB(to(move)) == makePiece(ROOK, c) && Movegen::isLegal(board, move) ? move : NO_MOVE;
+    }
+
+    PieceType pt = PAWN;
+    if (!san.empty() && sanPieceType(san[0]) != NONETYPE)
+    {
+        pt = sanPieceType(san[0]);
+        san.remove_prefix(1);
+    }
+
+    PieceType promotion = NONETYPE;
+    if (pt == PAWN && !san.empty() && sanPieceType(san.back()) != NONETYPE)
+    {
+        promotion = sanPieceType(san.back());
+        san.remove_suffix(1);
+        if (!san.empty() && san.back() == '=')
+            san.remove_suffix(1);
+    }
+
+    if (san.size() < 2)
+        return NO_MOVE;
+
+    const char file = san[san.size() - 2];
+    const char rank = san[san.size() - 1];
+    if (file < 'a' || file > 'h' || rank < '1' || rank > '8')
+        return NO_MOVE;
+
+    const Square target = file_rank_square(File(file - 'a'), Rank(rank - '1'));
+
+    // castling is only accepted as O-O
+    if (board.pieceAtB(target) != None && board.colorOf(target) == c)
+        return NO_MOVE;
+
+    // disambiguation, the capture sign is ignored
+    int fromFile = -1;
+    int fromRank = -1;
+    bool capture = false;
+    for (const char ch : san.substr(0, san.size() - 2))
+    {
+        if (ch >= 'a' && ch <= 'h')
+            fromFile = ch - 'a';
+        else if (ch >= '1' && ch <= '8')
+            fromRank = ch - '1';
+        else if (ch == 'x')
+            capture = true;
+    }
+
+    U64 candidates = 0ULL;
+    if (pt != PAWN)
+    {
+        candidates = board.attacksByPiece(pt, target, c) & board.pieces(pt, c);
+    }
+    else if (capture || fromFile >= 0)
+    {
+        candidates = PawnAttacks(target, ~c) & board.pieces(PAWN, c);
+    }
+    else
+    {
+        const Square behind = Square(c == White ? target - 8 : target + 8);
+        const bool doublePush = square_rank(target) == (c == White ? RANK_4 : RANK_5);
+
+        if (board.pieceAtB(behind) == makePiece(PAWN, c))
+            candidates = 1ULL << behind;
+        else if (doublePush && board.pieceAtB(behind) == None)
+            candidates = board.pieces(PAWN, c) & (1ULL << (c == White ? target - 16 : target + 16));
+    }
+
+    Move found = NO_MOVE;
+    while (candidates)
+    {
+        const Square from_sq = poplsb(candidates);
+        if ((fromFile >= 0 && square_file(from_sq) != fromFile) || (fromRank >= 0 && square_rank(from_sq) != fromRank))
+            continue;
+
+        const Move move = promotion != NONETYPE ? make(promotion, from_sq, target, true) : make(pt, from_sq, target);
+        if (!Movegen::isLegal(board, move))
+            continue;
+        if (found != NO_MOVE)
+            return NO_MOVE;
+
+        found = move;
+    }
+
+    return found;
+}
+
+} // namespace Chess
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "chess.hpp"
+
+namespace Chess
+{
+
+/********************
+ * Read only memory mapping of a whole file.
+ * The pages are loaded by the kernel on first access,
+ * nothing is copied into the process.
+ *******************/
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *mapped = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                madvise(mapped, size_t(st.st_size), MADV_SEQUENTIAL);
+                data = static_cast<const char *>(mapped);
+                length = size_t(st.st_size);
+            }
+        }
+
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+            munmap(const_cast<char *>(data), length);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /// @brief false when the file could not be opened or is empty
+    bool valid() const
+    {
+        return data != nullptr;
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(data, length);
+    }
+
+  private:
+    const char *data = nullptr;
+    size_t length = 0;
+};
+
+/// @brief splits text into at most parts pieces, every cut is made after a newline
+/// @param text
+/// @param parts
+/// @return
+inline std::vector<std::string_view> splitAtLines(std::string_view text, int parts)
+{
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+
+    for (int i = 1; i <= parts && start < text.size(); i++)
+    {
+        size_t end = i == parts ? text.size() : std::max(start, text.size() * i / parts);
+        end = end < text.size() ? text.find('\n', end) : text.size();
+        end = end == std::string_view::npos ? text.size() : end + 1;
+
+        chunks.push_back(text.substr(start, end - start));
+        start = end;
+    }
+
+    return chunks;
+}
+
+/// @brief calls f for every line of text, without the line break
+/// @param text
+/// @param f
+template <typename F> void forEachLine(std::string_view text, F &&f)
+{
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos)
+            end = text.size();
+
+        std::string_view line = text.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+
+        f(line);
+        start = end + 1;
+    }
+}
+
+/********************
+ * Loads every FEN/EPD line of a file, in parallel.
+ * The file is mapped and cut into one chunk per thread, each thread
+ * parses its lines into its own Board and hands it to the callback:
+ * callback(Board &board, std::string_view line, int thread)
+ * The callback runs on the worker threads. Empty lines and lines
+ * starting with '#' are skipped.
+ * Returns the number of positions, 0 when the file can not be read.
+ *******************/
+template <typename Callback> uint64_t loadFenFile(const std::string &path, int threads, Callback &&callback)
+{
+    const MappedFile file(path);
+    if (!file.valid())
+        return 0;
+
+    const std::vector<std::string_view> chunks = splitAtLines(file.view(), std::max(1, threads));
+    std::atomic<uint64_t> positions{0};
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < int(chunks.size()); t++)
+    {
+        workers.emplace_back([&, t]() {
+            Board board;
+            uint64_t count = 0;
+
+            forEachLine(chunks[t], [&](std::string_view line) {
+                if (line.empty() || line[0] == '#')
+                    return;
+
+                board.applyFen(line);
+                callback(board, line, t);
+                count++;
+            });
+
+            positions += count;
+        });
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    return positions;
+}
+
+} // namespace Chess
@@ -1,24 +1,167 @@
+#include "batch.hpp"
 #include "chess.hpp"
+#include "fileio.hpp"
+#include "perfcounters.hpp"
+#include "pgn.hpp"
+#include "search.hpp"
+#include "tt.hpp"
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 
 using namespace Chess;
 
+/********************
+ * Fixed size perft hash table, safe to share between threads.
+ * Entries are keyed by (hashKey, depth) and written without locks,
+ * every entry stores key ^ data next to data (lockless hashing), a torn
+ * write from another thread fails the key check and is treated as a miss.
+ * A bucket holds two entries, one is depth-preferred and only replaced by
+ * an equal or deeper subtree, the other is always replaced.
+ *******************/
+class PerftTable
+{
+  public:
+    explicit PerftTable(size_t mb = 64)
+    {
+        resize(mb);
+    }
+
+    void resize(size_t mb)
+    {
+        count = std::max<size_t>(1, (mb * 1024 * 1024) / sizeof(Bucket));
+        buckets.reset(new Bucket[count]);
+        clear();
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            for (Entry &e : buckets[i].entries)
+            {
+                e.key.store(0, std::memory_order_relaxed);
+                e.data.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t sizeMb() const
+    {
+        return count * sizeof(Bucket) / (1024 * 1024);
+    }
+
+    /// @brief looks up the node count of a subtree
+    /// @return true on a hit, nodes is only written on a hit
+    bool probe(U64 hash, int depth, uint64_t &nodes) const
+    {
+        const U64 key = mix(hash, depth);
+        const Bucket &bucket = buckets[index(key)];
+
+        for (const Entry &e : bucket.entries)
+        {
+            const U64 data = e.data.load(std::memory_order_relaxed);
+            if ((e.key.load(std::memory_order_relaxed) ^ data) == key && int(data & 0xFF) == depth)
+            {
+                nodes = data >> 8;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void store(U64 hash, int depth, uint64_t nodes)
+    {
+        const U64 key = mix(hash, depth);
+        Bucket &bucket = buckets[index(key)];
+        const U64 data = (nodes << 8) | U64(depth);
+
+        // depth-preferred slot first, otherwise always replace the second one
+        Entry &deep = bucket.entries[0];
+        Entry &e = int(deep.data.load(std::memory_order_relaxed) & 0xFF) <= depth ? deep : bucket.entries[1];
+
+        e.key.store(key ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+    }
+
+  private:
+    struct Entry
+    {
+        std::atomic<U64> key;
+        std::atomic<U64> data;
+    };
+
+    struct alignas(32) Bucket
+    {
+        Entry entries[2];
+    };
+
+    std::unique_ptr<Bucket[]> buckets;
+    size_t count = 0;
+
+    // folds the depth into the key, the same position at different depths
+    // lands in a different bucket
+    static constexpr U64 mix(U64 hash, int depth)
+    {
+        return hash ^ (U64(depth) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    size_t index(U64 key) const
+    {
+        return size_t((__uint128_t(key) * __uint128_t(count)) >> 64);
+    }
+};
+
+/********************
+ * Node count plus order independent checksums of the leaf hashKeys.
+ * Results of subtrees can be added up in any order, so counts from
+ * parallel or distributed runs can be checked against a reference.
+ *******************/
+struct PerftResult
+{
+    uint64_t nodes = 0;
+    U64 hashXor = 0;
+    U64 hashSum = 0;
+
+    PerftResult &operator+=(const PerftResult &other)
+    {
+        nodes += other.nodes;
+        hashXor ^= other.hashXor;
+        hashSum += other.hashSum;
+        return *this;
+    }
+};
+
 class PerftTest
 {
   public:
     uint64_t nodes;
 
+    // optional, perft uses the table when set
+    PerftTable *table = nullptr;
+
+    // optional, testPositionPerft reports the hardware counters per node when set
+    PerfCounters *counters = nullptr;
+
     uint64_t perft(Board &board, int depth)
     {
-        Movelist moves;
-        Movegen::legalmoves<ALL>(board, moves);
-
+        // bulk count the last ply
         if (depth == 1)
         {
-            return int(moves.size);
+            return Movegen::countLegalMoves<ALL>(board);
         }
 
+        Movelist moves;
+        Movegen::legalmoves<ALL>(board, moves);
+
         uint64_t nodes = 0;
 
         for (int i = 0; i < int(moves.size); i++)
@@ -41,14 +184,102 @@ class PerftTest
         return nodes;
     }
 
+    /// @brief copy-make perft, every child is a fresh Position
+    /// @param pos
+    /// @param depth
+    /// @return
+    uint64_t perft(const Position &pos, int depth)
+    {
+        if (depth == 1)
+        {
+            return Movegen::countLegalMoves<ALL>(pos);
+        }
+
+        Movelist moves;
+        Movegen::legalmoves<ALL>(pos, moves);
+
+        uint64_t nodes = 0;
+
+        for (int i = 0; i < int(moves.size); i++)
+        {
+            nodes += perft(pos.play(moves[i].move), depth - 1);
+        }
+
+        return nodes;
+    }
+
+    uint64_t perftHashed(Board &board, int depth)
+    {
+        if (depth == 1)
+        {
+            return Movegen::countLegalMoves<ALL>(board);
+        }
+
+        uint64_t nodes = 0;
+
+        if (table->probe(board.hashKey, depth, nodes))
+            return nodes;
+
+        Movelist moves;
+        Movegen::legalmoves<ALL>(board, moves);
+
+        for (int i = 0; i < int(moves.size); i++)
+        {
+            Move move = moves[i].move;
+            board.makeMove(move);
+            nodes += perftHashed(board, depth - 1);
+            board.unmakeMove(move);
+        }
+
+        table->store(board.hashKey, depth, nodes);
+
+        return nodes;
+    }
+
+    /// @brief perft that also visits the leaves to checksum their hashKeys
+    /// @param board
+    /// @param depth
+    /// @return
+    PerftResult perftChecksum(Board &board, int depth)
+    {
+        PerftResult result;
+
+        if (depth == 0)
+        {
+            result.nodes = 1;
+            result.hashXor = board.hashKey;
+            result.hashSum = board.hashKey;
+            return result;
+        }
+
+        Movelist moves;
+        Movegen::legalmoves<ALL>(board, moves);
+
+        for (int i = 0; i < int(moves.size); i++)
+        {
+            Move move = moves[i].move;
+            board.makeMove(move);
+            result += perftChecksum(board, depth - 1);
+            board.unmakeMove(move);
+        }
+
+        return result;
+    }
+
     uint64_t testPositionPerft(Board &board, int depth, uint64_t expectedNodeCount)
     {
         nodes = 0ull;
         std::stringstream ss;
 
+        if (counters)
+            counters->start();
+
         const auto t1 = std::chrono::high_resolution_clock::now();
-        const uint64_t n = perft(board, depth);
+        const uint64_t n = table ? perftHashed(board, depth) : perft(board, depth);
         const auto t2 = std::chrono::high_resolution_clock::now();
+
+        if (counters)
+            counters->stop();
         const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
 
         if (n != expectedNodeCount)
@@ -59,36 +290,231 @@ class PerftTest
         ss << "depth " << std::left << std::setw(2) << depth << " time " << std::setw(5) << ms << " nodes "
            << std::setw(12) << n << " nps " << std::setw(9) << (n * 1000) / (ms + 1) << " fen " << std::setw(87)
            << board.getFen();
+        if (counters)
+            ss << "\n         " << counters->report(n);
         std::cout << ss.str() << std::endl;
 
         return n;
     }
 };
 
-int main()
+/********************
+ * Parallel perft.
+ * The tree is split into tasks, a task is the move path from the root
+ * plus the remaining depth. Every worker owns a copy of the Board and a deque
+ * of tasks, it pops from the back of its own deque and steals from the front
+ * of the others, so stolen tasks are the oldest and largest ones.
+ * A task is split again instead of being counted while the queues are low,
+ * this spreads unbalanced subtrees over the idle workers.
+ *******************/
+class ParallelPerft
 {
-    Board board = Board(DEFAULT_POS);
-    PerftTest perft = PerftTest();
+  public:
+    explicit ParallelPerft(int threads, PerftTable *table = nullptr)
+        : threadCount(std::max(1, threads)), table(table), workers(threadCount)
+    {
+    }
 
-    U64 totalNodes = 0;
+    uint64_t perft(const Board &board, int depth)
+    {
+        return run(board, depth, false).nodes;
+    }
 
-    const auto t1 = std::chrono::high_resolution_clock::now();
-    totalNodes += perft.testPositionPerft(board, 7, 3195901860);
+    PerftResult perftChecksum(const Board &board, int depth)
+    {
+        return run(board, depth, true);
+    }
+
+  private:
+    static constexpr int MAX_SPLIT_PLY = 16;
+
+    // subtrees of this depth or less are never split
+    static constexpr int MIN_SPLIT_DEPTH = 3;
+
+    struct Task
+    {
+        Move path[MAX_SPLIT_PLY];
+        uint8_t length;
+        uint8_t depth;
+    };
+
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
 
-    board.applyFen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - ");
-    totalNodes += perft.testPositionPerft(board, 5, 193690690);
+    const int threadCount;
+    PerftTable *table;
+    std::vector<Worker> workers;
 
-    board.applyFen("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - ");
-    totalNodes += perft.testPositionPerft(board, 7, 178633661);
+    bool checksum = false;
 
-    board.applyFen("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
-    totalNodes += perft.testPositionPerft(board, 6, 706045033);
+    std::mutex resultMutex;
+    PerftResult total;
 
-    board.applyFen("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8");
-    totalNodes += perft.testPositionPerft(board, 5, 89941194);
+    // tasks waiting in any deque
+    std::atomic<int> queued{0};
 
-    board.applyFen("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10 ");
-    totalNodes += perft.testPositionPerft(board, 5, 164075551);
+    // tasks not finished yet, queued or running
+    std::atomic<int> pending{0};
+
+    PerftResult run(const Board &board, int depth, bool withChecksum)
+    {
+        assert(depth >= 1);
+
+        checksum = withChecksum;
+        total = PerftResult();
+        queued = 0;
+        pending = 0;
+
+        Task root{};
+        root.depth = depth;
+        push(0, root);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threadCount; i++)
+            threads.emplace_back(&ParallelPerft::work, this, i, std::cref(board));
+
+        for (auto &t : threads)
+            t.join();
+
+        return total;
+    }
+
+    void push(int id, const Task &task)
+    {
+        pending++;
+        queued++;
+        std::lock_guard<std::mutex> lock(workers[id].mutex);
+        workers[id].tasks.push_back(task);
+    }
+
+    bool pop(int id, Task &task)
+    {
+        std::lock_guard<std::mutex> lock(workers[id].mutex);
+        if (workers[id].tasks.empty())
+            return false;
+        task = workers[id].tasks.back();
+        workers[id].tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int id, Task &task)
+    {
+        for (int i = 1; i < threadCount; i++)
+        {
+            Worker &victim = workers[(id + i) % threadCount];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty())
+                continue;
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    bool shouldSplit(const Task &task) const
+    {
+        return threadCount > 1 && task.depth > MIN_SPLIT_DEPTH && task.length < MAX_SPLIT_PLY &&
+               queued < 2 * threadCount;
+    }
+
+    void work(int id, const Board &root)
+    {
+        Board board = root;
+        PerftTest test = PerftTest();
+        test.table = table;
+
+        PerftResult result;
+        Task task;
+
+        while (pending != 0)
+        {
+            if (!pop(id, task) && !steal(id, task))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            queued--;
+
+            for (int i = 0; i < task.length; i++)
+                board.makeMove(task.path[i]);
+
+            if (shouldSplit(task))
+            {
+                Movelist moves;
+                Movegen::legalmoves<ALL>(board, moves);
+
+                Task child = task;
+                child.length++;
+                child.depth--;
+
+                for (const auto &ext : moves)
+                {
+                    child.path[task.length] = ext.move;
+                    push(id, child);
+                }
+            }
+            else if (checksum)
+            {
+                result += test.perftChecksum(board, task.depth);
+            }
+            else
+            {
+                result.nodes += table ? test.perftHashed(board, task.depth) : test.perft(board, task.depth);
+            }
+
+            for (int i = task.length - 1; i >= 0; i--)
+                board.unmakeMove(task.path[i]);
+
+            // children are pushed before the parent is retired, pending can't hit 0 early
+            pending--;
+        }
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        total += result;
+    }
+};
+
+struct PerftPosition
+{
+    const char *fen;
+    int depth;
+    uint64_t nodes;
+};
+
+static const PerftPosition PERFT_SUITE[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 7, 3195901860},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - ", 5, 193690690},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - ", 7, 178633661},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 6, 706045033},
+    {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 5, 89941194},
+    {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10 ", 5, 164075551},
+};
+
+/// @brief runs the perft suite, optionally backed by a hash table
+/// @param table
+/// @param counters hardware counters per position when set
+/// @return total nodes
+uint64_t runPerftSuite(PerftTable *table = nullptr, PerfCounters *counters = nullptr)
+{
+    Board board = Board(DEFAULT_POS);
+    PerftTest perft = PerftTest();
+    perft.table = table;
+    perft.counters = counters;
+
+    U64 totalNodes = 0;
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        board.applyFen(pos.fen);
+        totalNodes += perft.testPositionPerft(board, pos.depth, pos.nodes);
+    }
 
     const auto t2 = std::chrono::high_resolution_clock::now();
     const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
@@ -96,5 +522,2020 @@ int main()
     std::cout << "\naveraged: \n"
               << "nodes " << totalNodes << " nps " << (totalNodes * 1000) / (ms + 1) << std::endl;
 
+    return totalNodes;
+}
+
+/********************
+ * Material only alpha-beta, searched once with the staged MovePicker and
+ * once with all moves generated up front, both use the same hash move
+ * and killers. Used to count the moves written to movelists per node.
+ *******************/
+class PickerBenchmark
+{
+  public:
+    uint64_t nodes = 0;
+    uint64_t generated = 0;
+
+    template <bool staged> int iterate(Board &board, int depth)
+    {
+        int score = 0;
+        for (int d = 1; d <= depth; d++)
+            score = search<staged>(board, -INF, INF, d, 0);
+        return score;
+    }
+
+  private:
+    static constexpr int INF = 32000;
+    static constexpr int VALUE[7] = {100, 300, 300, 500, 900, 0, 0};
+
+    Move killers[MAX_PLY][2] = {};
+    std::unordered_map<U64, Move> hashMoves;
+
+    static int evaluate(const Board &board)
+    {
+        int score = 0;
+        for (PieceType pt = PAWN; pt < KING; pt++)
+            score += VALUE[pt] * (popcount(board.pieces(pt, White)) - popcount(board.pieces(pt, Black)));
+        return board.sideToMove == White ? score : -score;
+    }
+
+    Move hashMove(const Board &board) const
+    {
+        const auto it = hashMoves.find(board.hashKey);
+        return it == hashMoves.end() ? NO_MOVE : it->second;
+    }
+
+    // the full generation counterpart of the MovePicker ordering
+    void scoreMoves(const Board &board, Movelist &moves, Move hash, int ply) const
+    {
+        for (auto &ext : moves)
+        {
+            const Move move = ext.move;
+            const PieceType victim = board.pieceTypeAtB(to(move));
+            if (move == hash)
+                ext.value = 1 << 20;
+            else if ((victim != NONETYPE && board.colorOf(to(move)) != board.sideToMove) || promoted(move))
+                ext.value = (1 << 16) + VALUE[victim] - VALUE[piece(move)] / 100;
+            else if (move == killers[ply][0] || move == killers[ply][1])
+                ext.value = 1 << 12;
+            else
+                ext.value = 0;
+        }
+    }
+
+    template <bool staged> int search(Board &board, int alpha, int beta, int depth, int ply)
+    {
+        nodes++;
+
+        if (depth == 0)
+            return evaluate(board);
+
+        const Move hash = hashMove(board);
+        Move best = NO_MOVE;
+        int bestScore = -INF;
+        int played = 0;
+
+        Movelist moves;
+        Movegen::MovePicker picker(board, hash, killers[ply][0], killers[ply][1]);
+
+        if (!staged)
+        {
+            Movegen::legalmoves<ALL>(board, moves);
+            generated += moves.size;
+            scoreMoves(board, moves, hash, ply);
+        }
+
+        while (true)
+        {
+            Move move;
+            if (staged)
+            {
+                move = picker.next();
+                if (move == NO_MOVE)
+                    break;
+            }
+            else
+            {
+                if (played == moves.size)
+                    break;
+                int pick = played;
+                for (int i = played + 1; i < moves.size; i++)
+                    if (moves[i] > moves[pick])
+                        pick = i;
+                std::swap(moves[played], moves[pick]);
+                move = moves[played].move;
+            }
+
+            played++;
+
+            board.makeMove(move);
+            const int score = -search<staged>(board, -beta, -alpha, depth - 1, ply + 1);
+            board.unmakeMove(move);
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = move;
+            }
+
+            if (score > alpha)
+                alpha = score;
+
+            if (alpha >= beta)
+            {
+                if (board.pieceAtB(to(move)) == None && !promoted(move) && move != killers[ply][0])
+                {
+                    killers[ply][1] = killers[ply][0];
+                    killers[ply][0] = move;
+                }
+                break;
+            }
+        }
+
+        if (staged)
+            generated += picker.generatedMoves();
+
+        if (played == 0)
+            return board.in_check() ? -INF + ply : 0;
+
+        hashMoves[board.hashKey] = best;
+
+        return bestScore;
+    }
+};
+
+/// @brief compares the staged MovePicker with full move generation in a small search
+/// @param depth
+void runPickerBenchmark(int depth)
+{
+    Board board = Board(DEFAULT_POS);
+
+    uint64_t nodes[2] = {}, generated[2] = {};
+    int64_t ms[2] = {};
+
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        for (int staged = 0; staged < 2; staged++)
+        {
+            board.applyFen(pos.fen);
+            PickerBenchmark bench;
+
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            const int score = staged ? bench.iterate<true>(board, depth) : bench.iterate<false>(board, depth);
+            const auto t2 = std::chrono::high_resolution_clock::now();
+
+            nodes[staged] += bench.nodes;
+            generated[staged] += bench.generated;
+            ms[staged] += std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+            std::stringstream ss;
+            ss << (staged ? "staged " : "full   ") << "score " << std::left << std::setw(6) << score << " nodes "
+               << std::setw(10) << bench.nodes << " moves/node " << std::fixed << std::setprecision(2)
+               << double(bench.generated) / double(bench.nodes) << " fen " << pos.fen;
+            std::cout << ss.str() << std::endl;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(2) << "\nmoves/node full " << double(generated[0]) / double(nodes[0])
+              << " staged " << double(generated[1]) / double(nodes[1]) << "\nnps full "
+              << (nodes[0] * 1000) / (ms[0] + 1) << " staged " << (nodes[1] * 1000) / (ms[1] + 1) << std::endl;
+}
+
+/// @brief perft and search nps with the per ply movegen cache off and on
+void runMovegenCacheBenchmark()
+{
+    Board board = Board(DEFAULT_POS);
+    PerftTest perft = PerftTest();
+
+    for (int cached = 0; cached < 2; cached++)
+    {
+        uint64_t perftNodes = 0, searchNodes = 0;
+        int64_t perftMs = 0, searchMs = 0;
+        bool correct = true;
+
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            board.applyFen(pos.fen);
+            board.cacheMovegen(cached);
+
+            auto t1 = std::chrono::high_resolution_clock::now();
+            const uint64_t n = perft.perft(board, pos.depth);
+            auto t2 = std::chrono::high_resolution_clock::now();
+
+            correct &= n == pos.nodes;
+            perftNodes += n;
+            perftMs += std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+            PickerBenchmark search;
+
+            t1 = std::chrono::high_resolution_clock::now();
+            search.iterate<true>(board, 5);
+            t2 = std::chrono::high_resolution_clock::now();
+
+            searchNodes += search.nodes;
+            searchMs += std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+        }
+
+        std::cout << (correct ? "" : "Wrong node count ") << (cached ? "cached     " : "recomputed ") << "perft nps "
+                  << std::left << std::setw(10) << (perftNodes * 1000) / (perftMs + 1) << " search nps "
+                  << (searchNodes * 1000) / (searchMs + 1) << std::endl;
+    }
+}
+
+/// @brief rook and bishop lookups per second of one slider backend
+/// @param name
+/// @param rook
+/// @param bishop
+template <typename Rook, typename Bishop> void runSliderLookups(const std::string &name, Rook rook, Bishop bishop)
+{
+    // random occupancies, generated up front so only the lookups are timed
+    std::vector<U64> occupancies(1 << 16);
+    U64 seed = 0x9E3779B97F4A7C15ULL;
+    for (U64 &occ : occupancies)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        occ = seed & (seed >> 11);
+    }
+
+    constexpr int rounds = 256;
+    U64 sink = 0;
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < occupancies.size(); i++)
+            sink += rook(int(i & 63), occupancies[i]) ^ bishop(int(i & 63), occupancies[i] ^ sink);
+    }
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+    const U64 lookups = 2ULL * rounds * occupancies.size();
+
+    std::cout << std::left << std::setw(6) << name << " lookups/s " << std::setw(12) << (lookups * 1000) / (ms + 1)
+              << " checksum " << sink << std::endl;
+}
+
+/// @brief attack unions per second of all sliders of one side, the way seenSquares uses them
+/// @param name
+/// @param sliderAttacks
+template <typename Union> void runSliderUnion(const std::string &name, Union sliderAttacks)
+{
+    std::vector<Board> boards;
+    for (const PerftPosition &pos : PERFT_SUITE)
+        boards.emplace_back(pos.fen);
+
+    constexpr int rounds = 1 << 22;
+    U64 sink = 0;
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    for (int r = 0; r < rounds; r++)
+    {
+        const Board &board = boards[r % boards.size()];
+        const Color c = Color(r & 1);
+        const U64 queens = board.pieces(QUEEN, c);
+        sink += sliderAttacks(board.pieces(ROOK, c) | queens, board.pieces(BISHOP, c) | queens, board.All() ^ (sink & 1));
+    }
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+    std::cout << "union " << std::left << std::setw(6) << name << " per second " << std::setw(12)
+              << (U64(rounds) * 1000) / (ms + 1) << " checksum " << sink << std::endl;
+}
+
+/********************
+ * Perft nps while co-running processes keep evicting our caches.
+ * Every position two plies below the suite roots is searched to depth 3
+ * on its own. Before each of them a buffer of mb MB is written,
+ * which is what another process does to L2/L3 during its time slice.
+ * Only the perft calls are timed.
+ *******************/
+void runCachePressureBenchmark(int mb)
+{
+    std::vector<U64> buffer(size_t(mb) * 1024 * 1024 / sizeof(U64));
+    Board board = Board(DEFAULT_POS);
+    PerftTest perft = PerftTest();
+
+    std::cout << "slider backend " << SLIDER_BACKEND << " tables " << Size / 1024 << " KB" << std::endl;
+
+    for (int pressure = 0; pressure < 2; pressure++)
+    {
+        uint64_t nodes = 0;
+        int64_t ns = 0;
+
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            board.applyFen(pos.fen);
+
+            Movelist moves;
+            Movegen::legalmoves<ALL>(board, moves);
+
+            for (const auto &ext : moves)
+            {
+                board.makeMove(ext.move);
+
+                Movelist replies;
+                Movegen::legalmoves<ALL>(board, replies);
+
+                for (const auto &reply : replies)
+                {
+                    board.makeMove(reply.move);
+
+                    // one write per cache line
+                    for (size_t i = 0; pressure && i < buffer.size(); i += 8)
+                        buffer[i] += i;
+
+                    const auto t1 = std::chrono::high_resolution_clock::now();
+                    nodes += perft.perft(board, 3);
+                    const auto t2 = std::chrono::high_resolution_clock::now();
+                    ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+
+                    board.unmakeMove(reply.move);
+                }
+
+                board.unmakeMove(ext.move);
+            }
+        }
+
+        std::cout << (pressure ? "evicted " : "warm    ") << std::left << std::setw(5) << mb << " MB nodes "
+                  << std::setw(12) << nodes << " nps " << (nodes * 1000000000) / (ns + 1) << std::endl;
+    }
+
+    // keeps the writes to the buffer alive
+    std::cout << "buffer checksum " << std::accumulate(buffer.begin(), buffer.end(), U64(0)) << std::endl;
+}
+
+/// @brief raw lookup speed of every available slider backend,
+/// followed by the perft suite on the backend the movegen was compiled with
+void runSliderBenchmark()
+{
+    runSliderLookups("fancy", Chess_Lookup::Fancy::RookAttacks, Chess_Lookup::Fancy::BishopAttacks);
+    runSliderLookups("obstr", Chess_Lookup::Obstruction::RookAttacks, Chess_Lookup::Obstruction::BishopAttacks);
+#if defined(USE_PEXT) && defined(__BMI2__)
+    runSliderLookups("pext", Chess_Lookup::Pext::RookAttacks, Chess_Lookup::Pext::BishopAttacks);
+#endif
+
+    runSliderUnion("lookup", SliderAttacksScalar);
+#if defined(__AVX2__)
+    runSliderUnion("avx2", SliderAttacksFill);
+#endif
+
+    std::cout << "\nmovegen backend " << SLIDER_BACKEND << std::endl;
+    runPerftSuite();
+}
+
+/// @brief prints the subtree size and leaf checksums for every root move
+/// @param board
+/// @param depth
+/// @param threads
+void divide(Board &board, int depth, int threads)
+{
+    ParallelPerft perft(threads);
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    PerftResult total;
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        const PerftResult result =
+            depth > 1 ? perft.perftChecksum(board, depth - 1) : PerftTest().perftChecksum(board, 0);
+        board.unmakeMove(ext.move);
+
+        total += result;
+
+        std::cout << std::left << std::setw(6) << convertMoveToUci(ext.move) << ": " << std::setw(12)
+                  << result.nodes << std::right << std::hex << std::setfill('0') << " xor " << std::setw(16)
+                  << result.hashXor << " sum " << std::setw(16) << result.hashSum << std::dec << std::setfill(' ')
+                  << std::endl;
+    }
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+    std::cout << "\nmoves " << int(moves.size) << " nodes " << total.nodes << std::hex << std::setfill('0')
+              << " xor " << std::setw(16) << total.hashXor << " sum " << std::setw(16) << total.hashSum << std::dec
+              << std::setfill(' ') << " time " << ms << std::endl;
+}
+
+/// @brief compares copy-make perft on Position with make/unmake perft on Board
+void runCopyMakeBenchmark()
+{
+    Board board = Board(DEFAULT_POS);
+    PerftTest perft = PerftTest();
+
+    uint64_t boardNodes = 0, positionNodes = 0;
+    int64_t boardMs = 0, positionMs = 0;
+
+    std::cout << "sizeof(Board) " << sizeof(Board) << " sizeof(Position) " << sizeof(Position) << "\n" << std::endl;
+
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        board.applyFen(pos.fen);
+        const Position position(board);
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        const uint64_t n1 = perft.perft(board, pos.depth);
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const uint64_t n2 = perft.perft(position, pos.depth);
+        const auto t3 = std::chrono::high_resolution_clock::now();
+
+        const auto ms1 = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+        const auto ms2 = std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count();
+
+        boardNodes += n1;
+        positionNodes += n2;
+        boardMs += ms1;
+        positionMs += ms2;
+
+        std::stringstream ss;
+        if (n1 != pos.nodes || n2 != pos.nodes)
+            ss << "Wrong node count ";
+        ss << "depth " << std::left << std::setw(2) << pos.depth << " make/unmake nps " << std::setw(10)
+           << (n1 * 1000) / (ms1 + 1) << " copy-make nps " << std::setw(10) << (n2 * 1000) / (ms2 + 1) << " fen "
+           << pos.fen;
+        std::cout << ss.str() << std::endl;
+    }
+
+    std::cout << "\ntotal: \n"
+              << "make/unmake nps " << (boardNodes * 1000) / (boardMs + 1) << " copy-make nps "
+              << (positionNodes * 1000) / (positionMs + 1) << std::endl;
+}
+
+/********************
+ * make/unmake pairs per second over the legal moves of the suite positions,
+ * once for all moves and once only for the rook moves and rook captures
+ * that have to update the castling rights.
+ *******************/
+void runMakeMoveBenchmark()
+{
+    constexpr int rounds = 200000;
+
+    Board board = Board(DEFAULT_POS);
+
+    for (int rookMoves = 0; rookMoves < 2; rookMoves++)
+    {
+        uint64_t pairs = 0;
+        U64 sink = 0;
+        int64_t ms = 0;
+
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            board.applyFen(pos.fen);
+
+            Movelist all, moves;
+            Movegen::legalmoves<ALL>(board, all);
+
+            for (const auto &ext : all)
+            {
+                if (!rookMoves || piece(ext.move) == ROOK || board.pieceTypeAtB(to(ext.move)) == ROOK)
+                    moves.Add(ext.move);
+            }
+
+            const auto t1 = std::chrono::high_resolution_clock::now();
+
+            for (int r = 0; r < rounds; r++)
+            {
+                for (const auto &ext : moves)
+                {
+                    board.makeMove(ext.move);
+                    sink += board.hashKey;
+                    board.unmakeMove(ext.move);
+                }
+            }
+
+            const auto t2 = std::chrono::high_resolution_clock::now();
+            ms += std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+            pairs += uint64_t(rounds) * moves.size;
+        }
+
+        std::cout << (rookMoves ? "rook moves " : "all moves  ") << "make/unmake pairs/s " << std::left
+                  << std::setw(10) << (pairs * 1000) / (ms + 1) << " ns per pair " << std::setw(8)
+                  << double(ms) * 1000000 / double(pairs) << " checksum " << sink << std::endl;
+    }
+}
+
+/// @brief Board constructions per second and the memory every game holds
+void runBoardConstructionBenchmark()
+{
+    constexpr int count = 100000;
+    U64 sink = 0;
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < count; i++)
+    {
+        const Board board(PERFT_SUITE[i % 6].fen);
+        sink += board.hashKey;
+    }
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+    // the histories reserve their capacity up front
+    const size_t heap = MAX_PLY * sizeof(State) + 512 * sizeof(U64) + MAX_PLY * sizeof(MovegenState);
+
+    std::cout << "sizeof(Board) " << sizeof(Board) << " bytes, with history buffers " << sizeof(Board) + heap
+              << " bytes per game\n"
+              << "constructions/s " << (U64(count) * 1000000) / (us + 1) << " checksum " << sink << std::endl;
+}
+
+/// @brief collects every position up to depth plies below board
+/// @param board
+/// @param depth
+/// @param positions
+void collectPositions(Board &board, int depth, std::vector<Position> &positions)
+{
+    positions.emplace_back(board);
+    if (depth == 0)
+        return;
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        collectPositions(board, depth - 1, positions);
+        board.unmakeMove(ext.move);
+    }
+}
+
+/********************
+ * Positions per second of the BoardBatch against the scalar movegen
+ * over all positions up to 3 plies below the suite roots.
+ * mode 0 only computes the movegen masks, 1 counts the moves
+ * and 2 writes them to a movelist.
+ *******************/
+void runBatchBenchmark()
+{
+    std::vector<Position> positions;
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        Board board = Board(pos.fen);
+        collectPositions(board, 3, positions);
+    }
+
+    std::cout << positions.size() << " positions, " << BATCH_LANES << " lanes" << std::endl;
+
+    for (int mode = 0; mode < 3; mode++)
+    {
+        uint64_t checksum[2] = {0, 0};
+        int64_t us[2] = {0, 0};
+        Movelist movelist;
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        for (const Position &pos : positions)
+        {
+            if (mode == 0)
+            {
+                Movegen::PositionMovegen board(pos);
+                if (pos.sideToMove == White)
+                    Movegen::init<White>(board, board.KingSQ(White));
+                else
+                    Movegen::init<Black>(board, board.KingSQ(Black));
+                checksum[0] += board.checkMask ^ board.pinHV ^ board.pinD ^ board.seen;
+            }
+            else if (mode == 1)
+                checksum[0] += Movegen::countLegalMoves<ALL>(pos);
+            else
+            {
+                Movegen::legalmoves<ALL>(pos, movelist);
+                checksum[0] += movelist.size;
+            }
+        }
+
+        auto t2 = std::chrono::high_resolution_clock::now();
+        us[0] = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+        BoardBatch batch;
+        t1 = std::chrono::high_resolution_clock::now();
+
+        for (size_t i = 0; i < positions.size(); i += BATCH_LANES)
+        {
+            batch.clear();
+            for (size_t j = i; j < positions.size() && batch.add(positions[j]); j++)
+                ;
+
+            batch.init();
+
+            for (int lane = 0; lane < batch.size(); lane++)
+            {
+                if (mode == 0)
+                    checksum[1] += batch.checkMask[lane] ^ batch.pinHV[lane] ^ batch.pinD[lane] ^ batch.seen[lane];
+                else if (mode == 1)
+                    checksum[1] += batch.countLegalMoves<ALL>(lane);
+                else
+                {
+                    batch.legalmoves<ALL>(lane, movelist);
+                    checksum[1] += movelist.size;
+                }
+            }
+        }
+
+        t2 = std::chrono::high_resolution_clock::now();
+        us[1] = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+        static const char *names[] = {"masks     ", "counts    ", "movelists "};
+
+        std::cout << (checksum[0] != checksum[1] ? "Wrong result " : "") << names[mode] << "scalar positions/s "
+                  << std::left << std::setw(10) << (positions.size() * 1000000) / (us[0] + 1)
+                  << " batch positions/s " << (positions.size() * 1000000) / (us[1] + 1) << std::endl;
+    }
+}
+
+/// @brief writes the fen of every position up to depth plies below board
+/// @param board
+/// @param depth
+/// @param out
+void writeFens(Board &board, int depth, std::ofstream &out)
+{
+    char fen[MAX_FEN_LENGTH];
+    const int length = board.writeFen(fen);
+    fen[length] = '\n';
+    out.write(fen, length + 1);
+
+    if (depth == 0)
+        return;
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        writeFens(board, depth - 1, out);
+        board.unmakeMove(ext.move);
+    }
+}
+
+/********************
+ * FEN parsing and writing per second on one thread, then the
+ * positions/s of the mmap bulk loader for 1..threads threads.
+ * The file is created from all positions up to 3 plies below
+ * the suite roots when it does not exist.
+ *******************/
+void runFenBenchmark(const std::string &path, int maxThreads)
+{
+    if (!std::ifstream(path))
+    {
+        std::ofstream out(path);
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            Board board = Board(pos.fen);
+            writeFens(board, 3, out);
+        }
+    }
+
+    std::vector<std::string> fens;
+    const uint64_t count = loadFenFile(path, 1, [&](Board &, std::string_view line, int) { fens.emplace_back(line); });
+    if (count == 0)
+    {
+        std::cout << "no positions in " << path << std::endl;
+        return;
+    }
+
+    Board board;
+    char buffer[MAX_FEN_LENGTH];
+    U64 sink = 0;
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (const auto &fen : fens)
+    {
+        board.applyFen(fen);
+        sink += board.hashKey;
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    const auto parseUs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+    t1 = std::chrono::high_resolution_clock::now();
+    for (const auto &fen : fens)
+    {
+        board.applyFen(fen);
+        sink += board.writeFen(buffer);
+    }
+    t2 = std::chrono::high_resolution_clock::now();
+    const auto writeUs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() - parseUs;
+
+    std::cout << count << " positions in " << path << "\n"
+              << "applyFen/s " << std::left << std::setw(10) << (count * 1000000) / (parseUs + 1) << " writeFen/s "
+              << (count * 1000000) / std::max<int64_t>(writeUs, 1) << " checksum " << sink << std::endl;
+
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        std::vector<U64> checksums(threads, 0);
+
+        t1 = std::chrono::high_resolution_clock::now();
+        const uint64_t loaded = loadFenFile(path, threads, [&](Board &b, std::string_view, int t) {
+            checksums[t] += b.hashKey;
+        });
+        t2 = std::chrono::high_resolution_clock::now();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+        std::cout << "threads " << std::setw(3) << threads << " loaded positions/s " << std::setw(10)
+                  << (loaded * 1000000) / (us + 1) << " checksum "
+                  << std::accumulate(checksums.begin(), checksums.end(), U64(0)) << std::endl;
+    }
+}
+
+/// @brief packs every position up to depth plies below board
+/// @param board
+/// @param depth
+/// @param packed
+void collectPacked(Board &board, int depth, std::vector<PackedBoard> &packed)
+{
+    packed.push_back(PackedBoard::pack(board));
+    if (depth == 0)
+        return;
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        collectPacked(board, depth - 1, packed);
+        board.unmakeMove(ext.move);
+    }
+}
+
+/********************
+ * unpack, pack and hash of PackedBoard per second over all positions
+ * up to 3 plies below the suite roots. Every position is checked to
+ * survive the round trip and to hash to Board::hashKey.
+ *******************/
+void runPackedBoardBenchmark()
+{
+    std::vector<PackedBoard> packed;
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        Board board = Board(pos.fen);
+        collectPacked(board, 3, packed);
+    }
+
+    Board board;
+    int wrong = 0;
+    for (const PackedBoard &p : packed)
+    {
+        p.unpack(board);
+        wrong += PackedBoard::pack(board) != p || p.hash() != board.hashKey;
+    }
+
+    std::cout << packed.size() << " positions, sizeof(PackedBoard) " << sizeof(PackedBoard) << " sizeof(Position) "
+              << sizeof(Position) << " sizeof(Board) " << sizeof(Board) << std::endl;
+    if (wrong)
+        std::cout << "Wrong round trips " << wrong << std::endl;
+
+    U64 sink = 0;
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (const PackedBoard &p : packed)
+    {
+        p.unpack(board);
+        sink += board.hashKey;
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    const auto unpackUs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+    // pack reads from a set of unpacked boards, cycled until every position was packed once
+    std::vector<Board> boards(1024);
+    for (size_t i = 0; i < boards.size(); i++)
+        packed[i * packed.size() / boards.size()].unpack(boards[i]);
+
+    t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < packed.size(); i++)
+    {
+        const PackedBoard p = PackedBoard::pack(boards[i % boards.size()]);
+        U64 nibbles[2];
+        std::memcpy(nibbles, p.pieces, sizeof(nibbles));
+        sink += p.occupied ^ nibbles[0] ^ nibbles[1];
+    }
+    t2 = std::chrono::high_resolution_clock::now();
+    const auto packUs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+    t1 = std::chrono::high_resolution_clock::now();
+    for (const PackedBoard &p : packed)
+        sink += p.hash();
+    t2 = std::chrono::high_resolution_clock::now();
+    const auto hashUs = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+    std::cout << "unpack/s " << std::left << std::setw(10) << (packed.size() * 1000000) / (unpackUs + 1) << " pack/s "
+              << std::setw(10) << (packed.size() * 1000000) / (packUs + 1) << " hash/s "
+              << std::setw(10) << (packed.size() * 1000000) / (hashUs + 1) << " checksum " << sink << std::endl;
+}
+
+/// @brief SAN of a legal move, disambiguated against the legal moves
+/// @param board
+/// @param move
+/// @return
+std::string sanFromMovelist(Board &board, Move move)
+{
+    static constexpr char PIECE_LETTERS[] = "PNBRQK";
+
+    const Square from_sq = from(move);
+    const Square to_sq = to(move);
+    const PieceType pt = board.pieceTypeAtB(from_sq);
+    std::string san;
+
+    if (pt == KING && board.pieceAtB(to_sq) == makePiece(ROOK, board.sideToMove))
+    {
+        san = to_sq > from_sq ? "O-O" : "O-O-O";
+    }
+    else
+    {
+        const bool capture = board.pieceAtB(to_sq) != None || (pt == PAWN && to_sq == board.enPassantSquare);
+
+        if (pt == PAWN)
+        {
+            if (capture)
+                san += squareToString[from_sq][0];
+        }
+        else
+        {
+            san += PIECE_LETTERS[pt];
+
+            Movelist moves;
+            Movegen::legalmoves<ALL>(board, moves);
+
+            bool ambiguous = false, sameFile = false, sameRank = false;
+            for (const auto &ext : moves)
+            {
+                const Square other = from(ext.move);
+                if (other == from_sq || to(ext.move) != to_sq || board.pieceTypeAtB(other) != pt)
+                    continue;
+                ambiguous = true;
+                sameFile |= square_file(other) == square_file(from_sq);
+                sameRank |= square_rank(other) == square_rank(from_sq);
+            }
+
+            if (ambiguous && (!sameFile || sameRank))
+                san += squareToString[from_sq][0];
+            if (ambiguous && sameFile)
+                san += squareToString[from_sq][1];
+        }
+
+        if (capture)
+            san += 'x';
+        san += squareToString[to_sq];
+
+        if (promoted(move))
+        {
+            san += '=';
+            san += PIECE_LETTERS[piece(move)];
+        }
+    }
+
+    board.makeMove(move);
+    if (board.isSquareAttacked(~board.sideToMove, board.KingSQ(board.sideToMove)))
+    {
+        Movelist replies;
+        Movegen::legalmoves<ALL>(board, replies);
+        san += replies.size ? '+' : '#';
+    }
+    board.unmakeMove(move);
+
+    return san;
+}
+
+/// @brief order dependent checksum of the moves of a game
+/// @param moves
+/// @return
+U64 movesChecksum(const std::vector<Move> &moves)
+{
+    U64 sum = 0;
+    for (size_t i = 0; i < moves.size(); i++)
+        sum += U64(moves[i]) * (i + 1);
+    return sum;
+}
+
+/// @brief order independent checksum of the variations of a game
+/// @param variations
+/// @return
+U64 variationsChecksum(const std::vector<PgnVariation> &variations)
+{
+    U64 sum = 0;
+    for (const auto &variation : variations)
+        sum += movesChecksum(variation.moves) * (variation.parentPly + 1);
+    return sum;
+}
+
+/********************
+ * Writes count random games to path, with tags, move numbers,
+ * comments, nested variations and line breaks like a PGN export.
+ * Some comments are wrapped so a line inside them starts with '['.
+ * Returns the checksum of the mainline moves of all games,
+ * the one of the variations goes to variationChecksum.
+ *******************/
+U64 writeRandomGames(const std::string &path, int count, U64 *variationChecksum = nullptr)
+{
+    std::ofstream out(path);
+    U64 seed = 0x2545F4914F6CDD1DULL;
+    U64 checksum = 0;
+    U64 variations = 0;
+
+    auto random = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+
+    Board board;
+    std::vector<Move> played;
+
+    for (int g = 0; g < count; g++)
+    {
+        board.applyFen(DEFAULT_POS);
+        played.clear();
+
+        std::string movetext;
+        std::string result = "*";
+        size_t lineStart = 0;
+
+        auto append = [&](const std::string &token) {
+            if (movetext.size() - lineStart + token.size() > 79)
+            {
+                movetext += '\n';
+                lineStart = movetext.size();
+            }
+            else if (!movetext.empty() && movetext.size() != lineStart)
+            {
+                movetext += ' ';
+            }
+            movetext += token;
+        };
+
+        for (int ply = 0; ply < 200; ply++)
+        {
+            Movelist moves;
+            Movegen::legalmoves<ALL>(board, moves);
+
+            if (moves.size == 0)
+            {
+                if (board.isSquareAttacked(~board.sideToMove, board.KingSQ(board.sideToMove)))
+                    result = board.sideToMove == White ? "0-1" : "1-0";
+                else
+                    result = "1/2-1/2";
+                break;
+            }
+
+            auto moveNumber = [](int p) { return std::to_string(p / 2 + 1) + (p % 2 ? "..." : "."); };
+            const std::string number = moveNumber(ply);
+            const Move move = moves[int(random() % moves.size)].move;
+
+            if (ply % 2 == 0)
+                append(number);
+
+            append(moveToSan(board, move));
+
+            // the clock wraps to a line of its own that starts with '[', like a tag
+            if (ply % 23 == 7)
+            {
+                append("{ a comment after ply " + std::to_string(ply));
+                movetext += '\n';
+                lineStart = movetext.size();
+                append("[%clk 0:" + std::to_string(10 + ply % 50) + ":00] }");
+            }
+
+            // an alternative with a comment and a reply, every other one
+            // with a nested alternative to the reply
+            if (ply % 31 == 11)
+            {
+                const Move alternative = moves[0].move;
+                append("( " + number);
+                append(moveToSan(board, alternative));
+                append("$1 { alternative }");
+                board.makeMove(alternative);
+
+                Movelist replies;
+                Movegen::legalmoves<ALL>(board, replies);
+                std::vector<Move> line = {alternative};
+                if (replies.size)
+                {
+                    const Move reply = replies[0].move;
+                    append(moveNumber(ply + 1));
+                    append(moveToSan(board, reply));
+                    line.push_back(reply);
+
+                    if (ply % 62 == 11 && replies.size > 1)
+                    {
+                        const Move nested = replies[replies.size - 1].move;
+                        append("( " + moveNumber(ply + 1));
+                        append(moveToSan(board, nested));
+                        append("{ nested } )");
+                        variations += movesChecksum({nested}) * 2;
+                    }
+                }
+                append(")");
+                board.unmakeMove(alternative);
+                variations += movesChecksum(line) * (ply + 1);
+            }
+
+            board.makeMove(move);
+            played.push_back(move);
+
+            if ((ply % 23 == 7 || ply % 31 == 11) && ply % 2 == 0)
+                append(std::to_string(ply / 2 + 1) + "...");
+        }
+
+        append(result);
+        checksum += movesChecksum(played);
+
+        out << "[Event \"Random game " << g << "\"]\n"
+            << "[Site \"?\"]\n"
+            << "[Date \"????.??.??\"]\n"
+            << "[Round \"" << g + 1 << "\"]\n"
+            << "[White \"random\"]\n"
+            << "[Black \"random\"]\n"
+            << "[Result \"" << result << "\"]\n\n"
+            << movetext << "\n\n";
+    }
+
+    if (variationChecksum)
+        *variationChecksum = variations;
+
+    return checksum;
+}
+
+/********************
+ * Games/s of the PGN reader on 1..maxThreads threads.
+ * Without a file 20000 random games are written to games.pgn
+ * and every decoded move, variations included, is checked against them.
+ *******************/
+void runPgnBenchmark(const std::string &path, int maxThreads)
+{
+    U64 expected = 0, expectedVariations = 0;
+    if (path.empty())
+        expected = writeRandomGames("games.pgn", 20000, &expectedVariations);
+
+    const std::string file = path.empty() ? "games.pgn" : path;
+    const double mb = double(std::ifstream(file, std::ios::ate | std::ios::binary).tellg()) / (1024 * 1024);
+
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        std::vector<U64> checksums(threads, 0), variationChecksums(threads, 0), moves(threads, 0),
+            errors(threads, 0);
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        const uint64_t games = readPgnFile(file, threads, [&](const PgnGame &game, int t) {
+            checksums[t] += movesChecksum(game.moves);
+            variationChecksums[t] += variationsChecksum(game.variations);
+            moves[t] += game.moves.size();
+            errors[t] += game.error;
+            for (const auto &variation : game.variations)
+                errors[t] += variation.error;
+        });
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+        const U64 checksum = std::accumulate(checksums.begin(), checksums.end(), U64(0));
+        const U64 variationChecksum = std::accumulate(variationChecksums.begin(), variationChecksums.end(), U64(0));
+
+        std::stringstream ss;
+        if (expected && checksum != expected)
+            ss << "Wrong moves ";
+        if (expected && variationChecksum != expectedVariations)
+            ss << "Wrong variations ";
+        ss << "threads " << std::left << std::setw(3) << threads << " games " << std::setw(8) << games << " moves "
+           << std::setw(10) << std::accumulate(moves.begin(), moves.end(), U64(0)) << " errors " << std::setw(4)
+           << std::accumulate(errors.begin(), errors.end(), U64(0)) << " games/s " << std::setw(9)
+           << (games * 1000) / (ms + 1) << " MB/s " << std::fixed << std::setprecision(1)
+           << mb * 1000 / double(ms + 1);
+        std::cout << ss.str() << std::endl;
+    }
+}
+
+/// @brief finds the legal move matching a SAN move by parsing it and scanning all legal moves
+/// @param board
+/// @param san check, mate and annotation suffixes are allowed
+/// @return NO_MOVE if no legal move or more than one matches
+Move sanFromMovelistToMove(Board &board, std::string_view san)
+{
+    while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?'))
+        san.remove_suffix(1);
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    const Piece ownRook = makePiece(ROOK, board.sideToMove);
+
+    if (san == "O-O" || san == "O-O-O" || san == "0-0" || san == "0-0-0")
+    {
+        const bool kingSide = san.size() == 3;
+        for (const auto &ext : moves)
+        {
+            const Square from_sq = from(ext.move);
+            const Square to_sq = to(ext.move);
+            if (board.pieceTypeAtB(from_sq) == KING && board.pieceAtB(to_sq) == ownRook &&
+                (to_sq > from_sq) == kingSide)
+                return ext.move;
+        }
+        return NO_MOVE;
+    }
+
+    PieceType pt = PAWN;
+    if (!san.empty() && sanPieceType(san[0]) != NONETYPE)
+    {
+        pt = sanPieceType(san[0]);
+        san.remove_prefix(1);
+    }
+
+    PieceType promotion = NONETYPE;
+    if (pt == PAWN && !san.empty() && sanPieceType(san.back()) != NONETYPE)
+    {
+        promotion = sanPieceType(san.back());
+        san.remove_suffix(1);
+        if (!san.empty() && san.back() == '=')
+            san.remove_suffix(1);
+    }
+
+    if (san.size() < 2)
+        return NO_MOVE;
+
+    const char file = san[san.size() - 2];
+    const char rank = san[san.size() - 1];
+    if (file < 'a' || file > 'h' || rank < '1' || rank > '8')
+        return NO_MOVE;
+
+    const Square target = file_rank_square(File(file - 'a'), Rank(rank - '1'));
+
+    // disambiguation, the capture sign is ignored
+    int fromFile = -1;
+    int fromRank = -1;
+    for (const char c : san.substr(0, san.size() - 2))
+    {
+        if (c >= 'a' && c <= 'h')
+            fromFile = c - 'a';
+        else if (c >= '1' && c <= '8')
+            fromRank = c - '1';
+    }
+
+    Move found = NO_MOVE;
+    for (const auto &ext : moves)
+    {
+        const Square from_sq = from(ext.move);
+        const Square to_sq = to(ext.move);
+
+        if (to_sq != target || board.pieceTypeAtB(from_sq) != pt)
+            continue;
+        // castling has to be written as castling
+        if (pt == KING && board.pieceAtB(to_sq) == ownRook)
+            continue;
+        if ((promoted(ext.move) ? piece(ext.move) : NONETYPE) != promotion)
+            continue;
+        if ((fromFile >= 0 && square_file(from_sq) != fromFile) || (fromRank >= 0 && square_rank(from_sq) != fromRank))
+            continue;
+        if (found != NO_MOVE)
+            return NO_MOVE;
+
+        found = ext.move;
+    }
+
+    return found;
+}
+
+/********************
+ * SAN conversions per second of moveToSan/sanToMove against SAN built
+ * from full legal move lists, over the mainlines of a PGN file
+ * (games.pgn with 20000 random games when no file is given).
+ * Every conversion is checked against the movelist version first.
+ * The times include making the moves along the games.
+ *******************/
+void runSanBenchmark(const std::string &path)
+{
+    const std::string file = path.empty() ? "games.pgn" : path;
+    if (path.empty() && !std::ifstream(file))
+        writeRandomGames(file, 20000);
+
+    struct Game
+    {
+        std::string fen;
+        std::vector<Move> moves;
+        std::vector<std::string> sans;
+    };
+
+    std::vector<Game> games;
+    readPgnFile(file, 1, [&](const PgnGame &game, int) {
+        const std::string_view fen = game.tag("FEN");
+        games.push_back({std::string(fen.empty() ? std::string_view(DEFAULT_POS) : fen), game.moves, {}});
+    });
+
+    Board board;
+    uint64_t plies = 0, wrong = 0;
+
+    for (Game &game : games)
+    {
+        board.applyFen(game.fen);
+        for (const Move move : game.moves)
+        {
+            const std::string san = moveToSan(board, move);
+            wrong += san != sanFromMovelist(board, move) || sanToMove(board, san) != move ||
+                     sanFromMovelistToMove(board, san) != move;
+            game.sans.push_back(san);
+            board.makeMove(move);
+            plies++;
+        }
+    }
+
+    std::cout << games.size() << " games, " << plies << " moves" << std::endl;
+    if (wrong)
+        std::cout << "Wrong conversions " << wrong << std::endl;
+
+    // 0 only replays the games, 1/2 encode, 3/4 decode
+    static const char *names[] = {"replay only      ", "moveToSan        ", "movelist encode  ",
+                                  "sanToMove        ", "movelist decode  "};
+    U64 sink = 0;
+
+    for (int mode = 0; mode < 5; mode++)
+    {
+        char buffer[MAX_SAN_LENGTH];
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+
+        for (const Game &game : games)
+        {
+            board.applyFen(game.fen);
+            for (size_t i = 0; i < game.moves.size(); i++)
+            {
+                const Move move = game.moves[i];
+                if (mode == 1)
+                    sink += moveToSan(board, move, buffer);
+                else if (mode == 2)
+                    sink += sanFromMovelist(board, move).size();
+                else if (mode == 3)
+                    sink += sanToMove(board, game.sans[i]);
+                else if (mode == 4)
+                    sink += sanFromMovelistToMove(board, game.sans[i]);
+                board.makeMove(move);
+            }
+        }
+
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+
+        std::cout << names[mode] << "moves/s " << std::left << std::setw(10) << (plies * 1000000) / (us + 1)
+                  << " checksum " << sink << std::endl;
+    }
+}
+
+struct EpdPerft
+{
+    std::string fen;
+
+    // expected node counts, index is the depth, 0 when the depth is not given
+    std::vector<uint64_t> nodes;
+};
+
+/// @brief reads a perft suite, one position per line: fen ;D1 20 ;D2 400 ...
+/// @param path
+/// @return
+std::vector<EpdPerft> readEpdPerftSuite(const std::string &path)
+{
+    std::vector<EpdPerft> suite;
+    const MappedFile file(path);
+    if (!file.valid())
+        return suite;
+
+    forEachLine(file.view(), [&](std::string_view line) {
+        const size_t fenEnd = std::min(line.find(';'), line.size());
+        std::string_view fen = line.substr(0, fenEnd);
+        while (!fen.empty() && fen.back() == ' ')
+            fen.remove_suffix(1);
+        if (fen.empty() || fen[0] == '#')
+            return;
+
+        EpdPerft pos{std::string(fen), {}};
+
+        size_t i = fenEnd;
+        while (i < line.size())
+        {
+            const size_t next = std::min(line.find(';', i + 1), line.size());
+            std::string_view field = line.substr(i + 1, next - i - 1);
+            i = next;
+
+            while (!field.empty() && field[0] == ' ')
+                field.remove_prefix(1);
+            if (field.size() < 2 || field[0] != 'D')
+                continue;
+
+            const size_t space = field.find(' ');
+            if (space == std::string_view::npos)
+                continue;
+
+            const int depth = std::atoi(std::string(field.substr(1, space - 1)).c_str());
+            if (depth <= 0)
+                continue;
+            if (int(pos.nodes.size()) <= depth)
+                pos.nodes.resize(depth + 1, 0);
+            pos.nodes[depth] = std::strtoull(std::string(field.substr(space + 1)).c_str(), nullptr, 10);
+        }
+
+        suite.push_back(std::move(pos));
+    });
+
+    return suite;
+}
+
+/********************
+ * Runs an EPD perft suite, positions are handed out to threads one at a time.
+ * Every given depth up to maxDepth is checked, a position stops at its first
+ * wrong count. Prints each position when it is done and the aggregate nps.
+ * Returns the number of positions with a wrong count.
+ *******************/
+int runEpdPerftSuite(const std::string &path, int maxDepth, int threads)
+{
+    const std::vector<EpdPerft> suite = readEpdPerftSuite(path);
+    if (suite.empty())
+    {
+        std::cout << "no positions in " << path << std::endl;
+        return 0;
+    }
+
+    std::cout << suite.size() << " positions, depth " << maxDepth << ", threads " << threads << std::endl;
+
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> totalNodes{0};
+    std::atomic<int> failed{0};
+    std::mutex output;
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    auto worker = [&]() {
+        Board board;
+        PerftTest perft = PerftTest();
+
+        for (size_t index = next++; index < suite.size(); index = next++)
+        {
+            const EpdPerft &pos = suite[index];
+            board.applyFen(pos.fen);
+
+            std::stringstream error;
+            uint64_t nodes = 0;
+            int depth = 0;
+
+            const auto start = std::chrono::high_resolution_clock::now();
+
+            for (int d = 1; d <= maxDepth && d < int(pos.nodes.size()); d++)
+            {
+                if (!pos.nodes[d])
+                    continue;
+
+                const uint64_t n = perft.perft(board, d);
+                nodes += n;
+                depth = d;
+
+                if (n != pos.nodes[d])
+                {
+                    error << " Wrong node count at depth " << d << ": " << n << " expected " << pos.nodes[d];
+                    break;
+                }
+            }
+
+            const auto end = std::chrono::high_resolution_clock::now();
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+            totalNodes += nodes;
+            failed += !error.str().empty();
+
+            std::stringstream ss;
+            ss << std::left << std::setw(5) << index + 1 << " depth " << std::setw(2) << depth << " time "
+               << std::setw(6) << ms << " nodes " << std::setw(12) << nodes << " nps " << std::setw(11)
+               << (nodes * 1000) / (ms + 1) << " fen " << pos.fen << error.str();
+
+            const std::lock_guard<std::mutex> lock(output);
+            std::cout << ss.str() << std::endl;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back(worker);
+    for (auto &w : workers)
+        w.join();
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+    std::cout << "\n"
+              << suite.size() << " positions " << failed << " failed time " << ms << " nodes " << totalNodes
+              << " nps " << (totalNodes * 1000) / (ms + 1) << std::endl;
+
+    return failed;
+}
+
+/// @brief a small pawn structure evaluation: doubled, isolated and passed pawns
+/// @param board
+/// @return score from white's point of view
+int evaluatePawns(const Board &board)
+{
+    int score = 0;
+
+    for (Color c : {White, Black})
+    {
+        const U64 pawns = board.pieces(PAWN, c);
+        const U64 enemy = board.pieces(PAWN, ~c);
+        int side = 0;
+
+        for (int file = 0; file < 8; file++)
+        {
+            const U64 onFile = pawns & MASK_FILE[file];
+            if (!onFile)
+                continue;
+
+            const U64 neighbours = (file > 0 ? MASK_FILE[file - 1] : 0ULL) | (file < 7 ? MASK_FILE[file + 1] : 0ULL);
+
+            side -= 12 * (popcount(onFile) - 1);
+            if (!(pawns & neighbours))
+                side -= 15 * popcount(onFile);
+        }
+
+        U64 bb = pawns;
+        while (bb)
+        {
+            const Square sq = poplsb(bb);
+            const int file = square_file(sq);
+            const int rank = square_rank(sq);
+            const U64 front = (file > 0 ? MASK_FILE[file - 1] : 0ULL) | MASK_FILE[file] |
+                              (file < 7 ? MASK_FILE[file + 1] : 0ULL);
+
+            // ranks in front of the pawn from its own side
+            U64 ahead = 0ULL;
+            for (int r = c == White ? rank + 1 : rank - 1; r >= 0 && r < 8; r += c == White ? 1 : -1)
+                ahead |= MASK_RANK[r];
+
+            if (!(enemy & front & ahead))
+                side += 10 + 8 * (c == White ? rank : 7 - rank);
+        }
+
+        score += c == White ? side : -side;
+    }
+
+    return score;
+}
+
+/// @brief checks the incremental keys against keys computed from scratch at every node
+/// @param board
+/// @param depth
+/// @return number of nodes with a wrong key
+uint64_t checkKeys(Board &board, int depth)
+{
+    const Board fresh(board.getFen());
+    uint64_t wrong = board.pawnKey != fresh.pawnKey || board.materialKey != fresh.materialKey ||
+                     board.nonPawnKey[White] != fresh.nonPawnKey[White] ||
+                     board.nonPawnKey[Black] != fresh.nonPawnKey[Black] || board.hashKey != fresh.hashKey;
+
+    if (depth == 0)
+        return wrong;
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        wrong += checkKeys(board, depth - 1);
+        board.unmakeMove(ext.move);
+    }
+
+    return wrong;
+}
+
+/// @brief pawn evaluation at every node, through the table when it is set
+/// @param board
+/// @param depth
+/// @param table
+/// @return sum of the evaluations
+int64_t pawnEvalTree(Board &board, int depth, PawnHashTable<int> *table)
+{
+    int64_t sum = table ? table->probe(board.pawnKey, [&]() { return evaluatePawns(board); }) : evaluatePawns(board);
+
+    if (depth == 0)
+        return sum;
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        sum += pawnEvalTree(board, depth - 1, table);
+        board.unmakeMove(ext.move);
+    }
+
+    return sum;
+}
+
+/********************
+ * Checks the pawn, material and non pawn keys at every node up to
+ * 3 plies below the suite roots, then compares the pawn evaluation
+ * of all nodes up to 4 plies with and without the pawn hash table.
+ *******************/
+void runPawnHashBenchmark()
+{
+    uint64_t wrong = 0;
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        Board board = Board(pos.fen);
+        wrong += checkKeys(board, 3);
+    }
+    std::cout << (wrong ? "Wrong keys at " + std::to_string(wrong) + " nodes" : "keys ok") << std::endl;
+
+    PawnHashTable<int> table(1 << 14);
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        int64_t sum = 0;
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            Board board = Board(pos.fen);
+            sum += pawnEvalTree(board, 4, mode ? &table : nullptr);
+        }
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+        std::cout << (mode ? "pawn hash table " : "no table        ") << "time " << std::setw(6) << ms << " checksum "
+                  << sum;
+        if (mode)
+            std::cout << " hits " << table.hitCount() << " misses " << table.missCount() << " hit rate "
+                      << std::fixed << std::setprecision(3)
+                      << double(table.hitCount()) / double(table.hitCount() + table.missCount());
+        std::cout << std::endl;
+    }
+}
+
+/// @brief probes and stores every node up to depth plies below board, the way a search uses the table
+/// @param board
+/// @param depth
+/// @param table
+/// @param hits
+/// @return nodes
+uint64_t ttWalk(Board &board, int depth, TranspositionTable &table, uint64_t &hits)
+{
+    TTData data;
+    hits += table.probe(board.hashKey, data);
+
+    Movelist moves;
+    Movegen::legalmoves<ALL>(board, moves);
+
+    if (depth == 0 || moves.size == 0)
+    {
+        table.store(board.hashKey, NO_MOVE, int(board.hashKey & 255), 0, BOUND_EXACT);
+        return 1;
+    }
+
+    uint64_t nodes = 1;
+    for (const auto &ext : moves)
+    {
+        board.makeMove(ext.move);
+        nodes += ttWalk(board, depth - 1, table, hits);
+        board.unmakeMove(ext.move);
+    }
+
+    table.store(board.hashKey, moves[0].move, 0, depth, BOUND_LOWER);
+    return nodes;
+}
+
+/********************
+ * Search transposition table benchmark:
+ * resize/clear time on 1..n threads, probes/s of n threads storing and
+ * probing random keys whose entry data is derived from the key (a hit
+ * with other data is a 16 bit key collision or a broken entry) and the
+ * nodes/s of a tree walk that probes every node, with the Board prefetch
+ * hook off and on.
+ *******************/
+void runSearchTTBenchmark(size_t mb, int maxThreads)
+{
+    TranspositionTable table(1);
+
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        table.resize(mb, threads);
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        table.clear(threads);
+        const auto t3 = std::chrono::high_resolution_clock::now();
+
+        std::cout << "threads " << std::left << std::setw(3) << threads << " resize "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms clear "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count() << " ms ("
+                  << table.sizeMb() << " MB)" << std::endl;
+    }
+
+    constexpr uint64_t OPS = 4000000;
+
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        table.clear(threads);
+        std::atomic<uint64_t> hits{0}, wrong{0};
+        std::vector<std::thread> workers;
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        for (int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&]() {
+                // all threads go through the same keys twice, the second round should hit
+                const uint64_t keys = OPS / uint64_t(threads) / 2;
+                uint64_t localHits = 0, localWrong = 0;
+                TTData data;
+
+                for (uint64_t i = 0; i < 2 * keys; i++)
+                {
+                    U64 key = (i % keys + 1) * 0x9E3779B97F4A7C15ULL;
+                    key ^= key >> 31;
+                    key *= 0xBF58476D1CE4E5B9ULL;
+                    key ^= key >> 29;
+
+                    if (table.probe(key, data))
+                    {
+                        localHits++;
+                        localWrong += data.move != Move(key >> 16) || data.score != int16_t(key >> 32) ||
+                                      data.depth != int(key >> 59);
+                    }
+                    table.store(key, Move(key >> 16), int16_t(key >> 32), int(key >> 59), BOUND_EXACT);
+                }
+
+                hits += localHits;
+                wrong += localWrong;
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+        std::cout << "threads " << std::left << std::setw(3) << threads << " probe+store/s " << std::setw(11)
+                  << (OPS * 1000) / uint64_t(ms + 1) << " hits " << std::setw(9) << hits << " mismatches " << wrong
+                  << std::endl;
+    }
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        table.clear(maxThreads);
+        uint64_t nodes = 0, hits = 0;
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            Board board = Board(pos.fen);
+            if (mode)
+                board.setPrefetch(TranspositionTable::prefetchHook, &table);
+
+            nodes += ttWalk(board, 4, table, hits);
+        }
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+        std::cout << (mode ? "prefetch    " : "no prefetch ") << "time " << std::setw(6) << ms << " nodes "
+                  << std::setw(10) << nodes << " nps " << std::setw(10) << (nodes * 1000) / uint64_t(ms + 1)
+                  << " hits " << std::setw(10) << hits << " hashfull " << table.hashfull() << std::endl;
+    }
+}
+
+/// @brief material only evaluation for the search benchmarks
+/// @param board
+/// @return score from the side to move's point of view
+int materialEval(Board &board)
+{
+    static constexpr int VALUE[5] = {100, 320, 330, 500, 900};
+
+    int score = 0;
+    for (PieceType pt = PAWN; pt < KING; pt++)
+        score += VALUE[pt] * (popcount(board.pieces(pt, White)) - popcount(board.pieces(pt, Black)));
+    return board.sideToMove == White ? score : -score;
+}
+
+/********************
+ * Searches every perft suite position to depth with an empty table and
+ * the material evaluation, prints each iteration with its nodes/s and
+ * effective branching factor, then the totals over the suite.
+ *******************/
+void runSearchBenchmark(int depth, size_t mb)
+{
+    TranspositionTable table(mb);
+    auto search = std::make_unique<Search>(table, materialEval);
+
+    uint64_t totalNodes = 0;
+    int64_t totalMs = 0;
+    double ebfSum = 0;
+    int ebfCount = 0;
+
+    for (const PerftPosition &pos : PERFT_SUITE)
+    {
+        Board board = Board(pos.fen);
+        table.clear();
+        search->clear();
+
+        std::cout << pos.fen << std::endl;
+
+        SearchInfo last;
+        const Move best = search->go(board, {depth, 0, 0}, [&](const SearchInfo &info) {
+            std::stringstream ss;
+            ss << "depth " << std::left << std::setw(3) << info.depth << " seldepth " << std::setw(3) << info.selDepth
+               << " score " << std::setw(6) << info.score << " nodes " << std::setw(10) << info.nodes << " nps "
+               << std::setw(9) << info.nps() << " ebf " << std::fixed << std::setprecision(2)
+               << info.branchingFactor << " pv";
+            for (int i = 0; i < info.pvLength; i++)
+                ss << " " << convertMoveToUci(info.pv[i]);
+            std::cout << ss.str() << std::endl;
+
+            if (info.depth > 1)
+            {
+                ebfSum += info.branchingFactor;
+                ebfCount++;
+            }
+            last = info;
+        });
+
+        std::cout << "bestmove " << (best == NO_MOVE ? "none" : convertMoveToUci(best)) << std::endl;
+        totalNodes += last.nodes;
+        totalMs += last.ms;
+    }
+
+    std::cout << "total nodes " << totalNodes << " time " << totalMs << " nps "
+              << (totalNodes * 1000) / uint64_t(totalMs + 1) << " average ebf " << std::fixed << std::setprecision(2)
+              << (ebfCount ? ebfSum / ebfCount : 0.0) << std::endl;
+}
+
+/********************
+ * Lazy SMP scaling: searches the perft suite positions to depth with
+ * 1, 2, 4, ... maxThreads threads and an empty table for each position,
+ * prints the summed time to depth and nodes/s with their speedup over
+ * one thread.
+ *******************/
+void runSmpBenchmark(int maxThreads, int depth, size_t mb)
+{
+    TranspositionTable table(mb, maxThreads);
+    double baseMs = 0, baseNps = 0;
+
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    for (const int threads : counts)
+    {
+        LazySmp smp(table, threads, materialEval);
+        uint64_t nodes = 0;
+        int64_t ms = 0;
+        std::string moves;
+
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            const Board board = Board(pos.fen);
+            table.clear(threads);
+            table.newSearch();
+
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            const Move best = smp.go(board, {depth, 0, 0});
+            const auto t2 = std::chrono::high_resolution_clock::now();
+
+            ms += std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+            nodes += smp.nodeCount();
+            moves += " " + (best == NO_MOVE ? std::string("none") : convertMoveToUci(best));
+        }
+
+        const double nps = double(nodes) * 1000.0 / double(ms + 1);
+        if (threads == 1)
+        {
+            baseMs = double(ms + 1);
+            baseNps = nps;
+        }
+
+        std::stringstream ss;
+        ss << "threads " << std::left << std::setw(3) << threads << " time to depth " << std::setw(7) << ms
+           << " nodes " << std::setw(11) << nodes << " nps " << std::setw(10) << uint64_t(nps) << " ttd speedup "
+           << std::fixed << std::setprecision(2) << std::setw(5) << baseMs / double(ms + 1) << " nps speedup "
+           << std::setw(5) << nps / baseNps << " bestmoves" << moves;
+        std::cout << ss.str() << std::endl;
+    }
+}
+
+/// @brief runs the perft suite for 1..maxThreads threads and prints the speedup
+/// @param maxThreads
+void runParallelPerftSuite(int maxThreads)
+{
+    Board board = Board(DEFAULT_POS);
+    double baseline = 0;
+
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        ParallelPerft perft(threads);
+        U64 totalNodes = 0;
+        bool correct = true;
+
+        const auto t1 = std::chrono::high_resolution_clock::now();
+
+        for (const PerftPosition &pos : PERFT_SUITE)
+        {
+            board.applyFen(pos.fen);
+            const uint64_t n = perft.perft(board, pos.depth);
+            correct &= n == pos.nodes;
+            totalNodes += n;
+        }
+
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+
+        if (threads == 1)
+            baseline = double(ms + 1);
+
+        std::stringstream ss;
+        if (!correct)
+            ss << "Wrong node count ";
+        ss << "threads " << std::left << std::setw(3) << threads << " time " << std::setw(6) << ms << " nodes "
+           << std::setw(12) << totalNodes << " nps " << std::setw(11) << (totalNodes * 1000) / (ms + 1)
+           << " speedup " << std::fixed << std::setprecision(2) << baseline / double(ms + 1);
+        std::cout << ss.str() << std::endl;
+    }
+}
+
+/********************
+ * Usage:
+ * out                  run the perft suite
+ * out tt [mb]          run the perft suite with a shared hash table, default 256 MB
+ * out parallel [n]     run the perft suite on 1..n threads, default all cores
+ * out divide d [fen]   perft divide to depth d with leaf hash checksums, default startpos
+ * out copymake         perft nps of copy-make Position against make/unmake Board
+ * out picker [d]       moves generated per node, staged MovePicker against full generation
+ * out movegencache     perft and search nps with the per ply movegen cache off and on
+ * out sliders          slider lookups/s per backend and perft nps of the compiled one (make pext)
+ * out boards           Board constructions per second and memory per game
+ * out makemove         make/unmake pairs per second
+ * out batch            positions/s of the BoardBatch against the scalar movegen
+ * out packed           PackedBoard unpack/pack/hash per second
+ * out pgn [file] [n]   games/s of the PGN reader on 1..n threads, without a file
+ *                      20000 random games are written to games.pgn and checked
+ * out san [file]       SAN conversions/s of moveToSan/sanToMove against full move lists
+ * out epd file [d] [n] run an EPD perft suite (fen ;D1 20 ;D2 400 ...) up to depth d, default 6,
+ *                      with n positions at a time, default all cores
+ * out counters         run the perft suite with hardware counters per node (Linux perf_event_open)
+ * out search [d] [mb]  iterative deepening search of the suite positions to depth d, default 10, 64 MB table
+ * out smp [n] [d] [mb] Lazy SMP time to depth d (default 9) and nps on 1, 2, 4 .. n threads, default all cores
+ * out searchtt [mb] [n] search transposition table resize/clear, probes/s and prefetch on 1..n threads
+ * out pawnhash         checks the incremental keys and times pawn evaluation with and without the pawn hash
+ * out fens [file] [n]  FEN parse/write per second and bulk loading of file on 1..n threads,
+ *                      default positions.epd (created when missing) and all cores
+ * out cachepressure [mb]
+ *                      perft nps of small subtrees, warm and with mb MB written before each, default 8
+ *******************/
+int main(int argc, char **argv)
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+
+    if (mode == "tt")
+    {
+        PerftTable table(argc > 2 ? std::stoul(argv[2]) : 256);
+        std::cout << "hash " << table.sizeMb() << " MB" << std::endl;
+        runPerftSuite(&table);
+        return 0;
+    }
+
+    if (mode == "parallel")
+    {
+        const int threads = argc > 2 ? std::stoi(argv[2]) : int(std::thread::hardware_concurrency());
+        runParallelPerftSuite(std::max(1, threads));
+        return 0;
+    }
+
+    if (mode == "divide" && argc > 2)
+    {
+        std::string fen;
+        for (int i = 3; i < argc; i++)
+            fen += std::string(i > 3 ? " " : "") + argv[i];
+
+        Board board = Board(fen.empty() ? DEFAULT_POS : fen);
+        divide(board, std::stoi(argv[2]), int(std::thread::hardware_concurrency()));
+        return 0;
+    }
+
+    if (mode == "picker")
+    {
+        runPickerBenchmark(argc > 2 ? std::stoi(argv[2]) : 5);
+        return 0;
+    }
+
+    if (mode == "movegencache")
+    {
+        runMovegenCacheBenchmark();
+        return 0;
+    }
+
+    if (mode == "sliders")
+    {
+        runSliderBenchmark();
+        return 0;
+    }
+
+    if (mode == "cachepressure")
+    {
+        runCachePressureBenchmark(argc > 2 ? std::stoi(argv[2]) : 8);
+        return 0;
+    }
+
+    if (mode == "makemove")
+    {
+        runMakeMoveBenchmark();
+        return 0;
+    }
+
+    if (mode == "boards")
+    {
+        runBoardConstructionBenchmark();
+        return 0;
+    }
+
+    if (mode == "batch")
+    {
+        runBatchBenchmark();
+        return 0;
+    }
+
+    if (mode == "packed")
+    {
+        runPackedBoardBenchmark();
+        return 0;
+    }
+
+    if (mode == "pgn")
+    {
+        const int threads = argc > 3 ? std::stoi(argv[3]) : int(std::thread::hardware_concurrency());
+        runPgnBenchmark(argc > 2 ? argv[2] : "", std::max(1, threads));
+        return 0;
+    }
+
+    if (mode == "san")
+    {
+        runSanBenchmark(argc > 2 ? argv[2] : "");
+        return 0;
+    }
+
+    if (mode == "epd" && argc > 2)
+    {
+        const int depth = argc > 3 ? std::stoi(argv[3]) : 6;
+        const int threads = argc > 4 ? std::stoi(argv[4]) : int(std::thread::hardware_concurrency());
+        return runEpdPerftSuite(argv[2], depth, std::max(1, threads)) ? 1 : 0;
+    }
+
+    if (mode == "counters")
+    {
+        PerfCounters counters;
+        if (!counters.available())
+            std::cout << "no hardware counters, check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+        runPerftSuite(nullptr, &counters);
+        return 0;
+    }
+
+    if (mode == "search")
+    {
+        runSearchBenchmark(argc > 2 ? std::stoi(argv[2]) : 10, argc > 3 ? std::stoul(argv[3]) : 64);
+        return 0;
+    }
+
+    if (mode == "smp")
+    {
+        const int threads = argc > 2 ? std::stoi(argv[2]) : int(std::thread::hardware_concurrency());
+        runSmpBenchmark(std::clamp(threads, 1, 64), argc > 3 ? std::stoi(argv[3]) : 9,
+                        argc > 4 ? std::stoul(argv[4]) : 64);
+        return 0;
+    }
+
+    if (mode == "searchtt")
+    {
+        const int threads = argc > 3 ? std::stoi(argv[3]) : int(std::thread::hardware_concurrency());
+        runSearchTTBenchmark(argc > 2 ? std::stoul(argv[2]) : 256, std::max(1, threads));
+        return 0;
+    }
+
+    if (mode == "pawnhash")
+    {
+        runPawnHashBenchmark();
+        return 0;
+    }
+
+    if (mode == "fens")
+    {
+        const int threads = argc > 3 ? std::stoi(argv[3]) : int(std::thread::hardware_concurrency());
+        runFenBenchmark(argc > 2 ? argv[2] : "positions.epd", std::max(1, threads));
+        return 0;
+    }
+
+    if (mode == "copymake")
+    {
+        runCopyMakeBenchmark();
+        return 0;
+    }
+
+    runPerftSuite();
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/********************
+ * Hardware performance counters of the calling thread through Linux perf_event_open.
+ * Every event is opened on its own so the kernel multiplexes them when there are
+ * more events than counters, the values are scaled by the time each one ran.
+ * Events the cpu or the kernel (perf_event_paranoid) refuses read as unavailable,
+ * on other systems all of them are.
+ *******************/
+class PerfCounters
+{
+  public:
+    enum Event
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        LLC_MISSES,
+        DTLB_MISSES,
+        EVENT_COUNT
+    };
+
+    PerfCounters()
+    {
+#if defined(__linux__)
+        static constexpr uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        static constexpr uint64_t LL_READ_MISS = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        static constexpr uint64_t DTLB_READ_MISS = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+        fds[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        fds[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        fds[BRANCH_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        fds[L1D_MISSES] = open(PERF_TYPE_HW_CACHE, L1D_READ_MISS);
+        fds[LLC_MISSES] = open(PERF_TYPE_HW_CACHE, LL_READ_MISS);
+        fds[DTLB_MISSES] = open(PERF_TYPE_HW_CACHE, DTLB_READ_MISS);
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    /// @brief true if at least one event could be opened
+    bool available() const
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool available(Event e) const
+    {
+        return fds[e] >= 0;
+    }
+
+    /// @brief resets and starts all events
+    void start()
+    {
+#if defined(__linux__)
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    /// @brief stops all events and reads their values
+    void stop()
+    {
+#if defined(__linux__)
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+
+        for (int e = 0; e < EVENT_COUNT; e++)
+        {
+            values[e] = 0;
+            if (fds[e] < 0)
+                continue;
+
+            // value, time enabled, time running
+            uint64_t data[3] = {0, 0, 0};
+            if (::read(fds[e], data, sizeof(data)) != sizeof(data))
+                continue;
+
+            values[e] = data[2] ? uint64_t(double(data[0]) * double(data[1]) / double(data[2])) : data[0];
+        }
+#endif
+    }
+
+    /// @brief value of the last start/stop interval
+    uint64_t value(Event e) const
+    {
+        return values[e];
+    }
+
+    /// @brief per node values and IPC of the last interval, unavailable events show as -
+    /// @param nodes
+    /// @return
+    std::string report(uint64_t nodes) const
+    {
+        static const char *NAMES[EVENT_COUNT] = {"cycles", "instr", "br-miss", "L1D-miss", "LLC-miss", "dTLB-miss"};
+
+        std::string out;
+        char buffer[64];
+
+        for (int e = 0; e < EVENT_COUNT; e++)
+        {
+            if (fds[e] >= 0)
+                std::snprintf(buffer, sizeof(buffer), "%s/node %-8.3f ", NAMES[e],
+                              double(values[e]) / double(nodes ? nodes : 1));
+            else
+                std::snprintf(buffer, sizeof(buffer), "%s/node -        ", NAMES[e]);
+            out += buffer;
+
+            if (e == INSTRUCTIONS)
+            {
+                const double ipc = values[CYCLES] ? double(values[INSTRUCTIONS]) / double(values[CYCLES]) : 0.0;
+                if (fds[CYCLES] >= 0 && fds[INSTRUCTIONS] >= 0 && values[CYCLES])
+                    std::snprintf(buffer, sizeof(buffer), "IPC %-5.2f ", ipc);
+                else
+                    std::snprintf(buffer, sizeof(buffer), "IPC -     ");
+                out += buffer;
+            }
+        }
+
+        return out;
+    }
+
+  private:
+    int fds[EVENT_COUNT] = {-1, -1, -1, -1, -1, -1};
+    uint64_t values[EVENT_COUNT] = {};
+
+#if defined(__linux__)
+    /// @brief opens one disabled user space event of the calling thread
+    /// @param type
+    /// @param config
+    /// @return the fd, -1 if the event is not available
+    static int open(uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+};
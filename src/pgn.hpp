@@ -0,0 +1,430 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "chess.hpp"
+#include "fileio.hpp"
+
+namespace Chess
+{
+
+struct PgnTag
+{
+    std::string_view name;
+
+    // without the quotes, escapes are left as they are
+    std::string_view value;
+};
+
+struct PgnComment
+{
+    // number of mainline moves played before the comment
+    int ply;
+
+    // without the braces or the leading ';'
+    std::string_view text;
+};
+
+/********************
+ * A recursive annotation variation (RAV), an alternative to one move
+ * of its parent line. Its first move replaces parent move parentPly,
+ * so it is played from the position after the first parentPly moves
+ * of the parent line.
+ *******************/
+struct PgnVariation
+{
+    // index in PgnGame::variations of the line it branches from, -1 for the mainline
+    int parent;
+
+    int parentPly;
+
+    std::vector<Move> moves;
+
+    // ply counts the moves of this variation
+    std::vector<PgnComment> comments;
+
+    // set when a SAN move could not be matched or the variation has no move
+    // to branch from, moves ends before it
+    bool error = false;
+};
+
+/********************
+ * One game of a PGN file. All views point into the mapped file.
+ * The mainline is in moves and comments, every variation is a
+ * PgnVariation in the order they appear, nested ones point to
+ * their parent.
+ * A game is reused for every game of a thread, it is only valid
+ * during the callback.
+ *******************/
+struct PgnGame
+{
+    // the whole game, from the first tag to the result
+    std::string_view text;
+
+    std::vector<PgnTag> tags;
+
+    std::vector<Move> moves;
+
+    std::vector<PgnComment> comments;
+
+    std::vector<PgnVariation> variations;
+
+    // empty when the movetext has no result
+    std::string_view result;
+
+    // set when a mainline SAN move could not be matched, moves ends before it
+    bool error = false;
+
+    /// @brief moves of a line
+    /// @param line index in variations, -1 for the mainline
+    /// @return
+    const std::vector<Move> &lineMoves(int line) const
+    {
+        return line < 0 ? moves : variations[line].moves;
+    }
+
+    /// @brief value of the tag, empty if the game does not have it
+    /// @param name
+    /// @return
+    std::string_view tag(std::string_view name) const
+    {
+        for (const PgnTag &t : tags)
+        {
+            if (t.name == name)
+                return t.value;
+        }
+        return {};
+    }
+
+    void clear()
+    {
+        text = {};
+        tags.clear();
+        moves.clear();
+        comments.clear();
+        variations.clear();
+        result = {};
+        error = false;
+    }
+};
+
+/// @brief follows the brace comments through one movetext line
+/// @param line
+/// @param inComment in: open comment at the start of the line, out: at its end
+/// @return length of the line outside of a trailing ';' comment
+inline size_t scanPgnLine(std::string_view line, bool &inComment)
+{
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        if (inComment)
+            inComment = line[i] != '}';
+        else if (line[i] == '{')
+            inComment = true;
+        else if (line[i] == ';')
+            return i;
+    }
+    return line.size();
+}
+
+/// @brief true if the last token of the line is a game result
+/// @param line
+/// @return
+inline bool endsWithPgnResult(std::string_view line)
+{
+    while (!line.empty() && (line.back() == ' ' || line.back() == '\r' || line.back() == '\t'))
+        line.remove_suffix(1);
+
+    const size_t space = line.find_last_of(" \t");
+    const std::string_view token = space == std::string_view::npos ? line : line.substr(space + 1);
+    return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+}
+
+/// @brief start of the first game at or after pos: a tag line outside of a comment
+/// that follows a blank line or a line ending with a result, and no other tag line
+/// @param text
+/// @param pos
+/// @return text.size() if there is none
+inline size_t nextPgnGame(std::string_view text, size_t pos)
+{
+    if (pos == 0)
+        return 0;
+
+    size_t line = text.rfind('\n', pos - 1);
+    line = line == std::string_view::npos ? 0 : line + 1;
+
+    // whether the line pos is in starts inside a comment, comments are
+    // assumed to be shorter than the window that is looked at
+    constexpr size_t LOOKBACK = 1 << 16;
+    bool inComment = false;
+    for (size_t i = line; i > 0 && line - i < LOOKBACK; i--)
+    {
+        if (text[i - 1] == '}')
+            break;
+        if (text[i - 1] == '{')
+        {
+            inComment = true;
+            break;
+        }
+    }
+
+    bool afterTag = false, afterBlank = false, afterResult = false;
+
+    while (line < text.size())
+    {
+        size_t next = text.find('\n', line);
+        next = next == std::string_view::npos ? text.size() : next;
+        const std::string_view content = text.substr(line, next - line);
+
+        const bool isTag = !inComment && !content.empty() && content[0] == '[';
+        if (isTag && line > pos && !afterTag && (afterBlank || afterResult))
+            return line;
+
+        const bool blank = content.find_first_not_of(" \t\r") == std::string_view::npos;
+        if (!blank)
+        {
+            afterTag = isTag;
+            afterResult = false;
+            if (!isTag)
+            {
+                const size_t length = scanPgnLine(content, inComment);
+                afterResult = !inComment && endsWithPgnResult(content.substr(0, length));
+            }
+        }
+        afterBlank = blank && !inComment;
+
+        line = next + 1;
+    }
+
+    return text.size();
+}
+
+/********************
+ * Parses all games of text on one thread.
+ * callback(const PgnGame &game, int thread) is called for every game,
+ * board is used to decode the SAN moves.
+ * Returns the number of games.
+ *******************/
+template <typename Callback>
+uint64_t parsePgnGames(std::string_view text, Board &board, PgnGame &game, int thread, Callback &&callback)
+{
+    uint64_t games = 0;
+    size_t i = 0;
+    size_t gameStart = std::string_view::npos;
+    bool inMovetext = false;
+
+    // open variations, innermost last, as index in game.variations
+    std::vector<int> lines;
+
+    auto finish = [&](size_t end) {
+        if (gameStart != std::string_view::npos)
+        {
+            game.text = text.substr(gameStart, end - gameStart);
+            callback(static_cast<const PgnGame &>(game), thread);
+            games++;
+        }
+        game.clear();
+        gameStart = std::string_view::npos;
+        inMovetext = false;
+        lines.clear();
+    };
+
+    auto currentLine = [&]() { return lines.empty() ? -1 : lines.back(); };
+
+    auto lineFailed = [&](int line) { return line < 0 ? game.error : game.variations[line].error; };
+
+    auto startMovetext = [&]() {
+        if (inMovetext)
+            return;
+        inMovetext = true;
+
+        const std::string_view fen = game.tag("FEN");
+        board.applyFen(fen.empty() ? std::string_view(DEFAULT_POS) : fen);
+    };
+
+    auto isDelimiter = [](char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '{' || c == '}' || c == '(' || c == ')' ||
+               c == '[' || c == ']' || c == ';';
+    };
+
+    while (i < text.size())
+    {
+        const char c = text[i];
+
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+        {
+            i++;
+        }
+        else if (c == '[')
+        {
+            if (inMovetext)
+                finish(i);
+            if (gameStart == std::string_view::npos)
+                gameStart = i;
+
+            const size_t end = text.find('\n', i);
+            const std::string_view line = text.substr(i + 1, end == std::string_view::npos ? end : end - i - 1);
+            i = end == std::string_view::npos ? text.size() : end + 1;
+
+            const size_t space = line.find(' ');
+            const size_t open = line.find('"');
+            const size_t close = line.rfind('"');
+            if (space != std::string_view::npos && open != std::string_view::npos && close > open)
+                game.tags.push_back({line.substr(0, space), line.substr(open + 1, close - open - 1)});
+        }
+        else if (c == '{' || c == ';')
+        {
+            const size_t end = text.find(c == '{' ? '}' : '\n', i + 1);
+            std::string_view comment =
+                text.substr(i + 1, end == std::string_view::npos ? std::string_view::npos : end - i - 1);
+            i = end == std::string_view::npos ? text.size() : end + 1;
+
+            if (c == ';' && !comment.empty() && comment.back() == '\r')
+                comment.remove_suffix(1);
+
+            if (gameStart != std::string_view::npos)
+            {
+                const int line = currentLine();
+                std::vector<PgnComment> &comments = line < 0 ? game.comments : game.variations[line].comments;
+                comments.push_back({int(game.lineMoves(line).size()), comment});
+            }
+        }
+        else if (c == '(')
+        {
+            // the variation replaces the last move of its parent, the board
+            // is unmade back to the branch point and remade on ')'
+            const int parent = currentLine();
+            const std::vector<Move> &parentMoves = game.lineMoves(parent);
+
+            PgnVariation variation{parent, int(parentMoves.size()) - 1, {}, {}, false};
+            if (lineFailed(parent) || parentMoves.empty())
+            {
+                variation.parentPly = int(parentMoves.size());
+                variation.error = true;
+            }
+            else
+                board.unmakeMove(parentMoves.back());
+
+            game.variations.push_back(std::move(variation));
+            lines.push_back(int(game.variations.size()) - 1);
+            i++;
+        }
+        else if (c == ')')
+        {
+            if (!lines.empty())
+            {
+                const PgnVariation &variation = game.variations[lines.back()];
+                for (auto it = variation.moves.rbegin(); it != variation.moves.rend(); ++it)
+                    board.unmakeMove(*it);
+
+                // a failed variation never unmade its parent
+                const std::vector<Move> &parentMoves = game.lineMoves(variation.parent);
+                if (variation.parentPly < int(parentMoves.size()))
+                    board.makeMove(parentMoves[variation.parentPly]);
+
+                lines.pop_back();
+            }
+            i++;
+        }
+        else
+        {
+            size_t end = i;
+            while (end < text.size() && !isDelimiter(text[end]))
+                end++;
+
+            std::string_view token = text.substr(i, end - i);
+            i = end;
+
+            if (gameStart == std::string_view::npos)
+                gameStart = token.data() - text.data();
+
+            if (token[0] == '$')
+                continue;
+
+            if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*")
+            {
+                if (!lines.empty())
+                    continue;
+
+                game.result = token;
+                finish(i);
+                continue;
+            }
+
+            // move numbers, possibly glued to the move
+            if (token[0] >= '1' && token[0] <= '9')
+            {
+                while (!token.empty() && ((token[0] >= '0' && token[0] <= '9') || token[0] == '.'))
+                    token.remove_prefix(1);
+                if (token.empty())
+                    continue;
+            }
+
+            startMovetext();
+            const int line = currentLine();
+            if (lineFailed(line))
+                continue;
+
+            const Move move = sanToMove(board, token);
+            if (move == NO_MOVE)
+            {
+                (line < 0 ? game.error : game.variations[line].error) = true;
+                continue;
+            }
+
+            (line < 0 ? game.moves : game.variations[line].moves).push_back(move);
+            board.makeMove(move);
+        }
+    }
+
+    finish(text.size());
+
+    return games;
+}
+
+/********************
+ * Reads every game of a PGN file, in parallel.
+ * The file is mapped and cut at game boundaries into one chunk per
+ * thread, every thread decodes its games with its own Board and calls
+ * callback(const PgnGame &game, int thread) on the worker thread.
+ * Returns the number of games, 0 when the file can not be read.
+ *******************/
+template <typename Callback> uint64_t readPgnFile(const std::string &path, int threads, Callback &&callback)
+{
+    const MappedFile file(path);
+    if (!file.valid())
+        return 0;
+
+    const std::string_view text = file.view();
+    const int parts = std::max(1, threads);
+
+    std::vector<size_t> starts(parts + 1, text.size());
+    starts[0] = 0;
+    for (int t = 1; t < parts; t++)
+        starts[t] = std::max(starts[t - 1], nextPgnGame(text, text.size() * t / parts));
+
+    std::atomic<uint64_t> games{0};
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < parts; t++)
+    {
+        if (starts[t] == starts[t + 1])
+            continue;
+
+        workers.emplace_back([&, t]() {
+            Board board;
+            PgnGame game;
+            games += parsePgnGames(text.substr(starts[t], starts[t + 1] - starts[t]), board, game, t, callback);
+        });
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    return games;
+}
+
+} // namespace Chess
@@ -0,0 +1,614 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "chess.hpp"
+#include "tt.hpp"
+
+namespace Chess
+{
+
+static constexpr int VALUE_INFINITE = 32001;
+static constexpr int VALUE_MATE = 32000;
+
+// scores beyond this are mates, they are stored in the table relative to the node
+static constexpr int VALUE_MATE_IN_MAX_PLY = VALUE_MATE - MAX_PLY;
+
+/// @brief scores are from the side to move's point of view
+using Evaluate = int (*)(Board &board);
+
+/// @brief 0 means no limit, a search without any limit runs to MAX_PLY
+struct SearchLimits
+{
+    int depth = 0;
+    uint64_t nodes = 0;
+    int64_t timeMs = 0;
+};
+
+/// @brief result of one completed iteration
+struct SearchInfo
+{
+    int depth = 0;
+    int selDepth = 0;
+    int score = 0;
+    uint64_t nodes = 0;
+    int64_t ms = 0;
+
+    // nodes of this iteration divided by the nodes of the previous one
+    double branchingFactor = 0;
+
+    const Move *pv = nullptr;
+    int pvLength = 0;
+
+    uint64_t nps() const
+    {
+        return nodes * 1000 / uint64_t(ms + 1);
+    }
+};
+
+/********************
+ * Iterative deepening principal variation search.
+ * Every iteration runs a PVS with a transposition table, null move pruning,
+ * killer moves through the staged MovePicker, a check extension and a
+ * quiescence search over the captures. Repetitions and the 50 move rule
+ * score as draws.
+ * All per ply state lives in fixed arrays of the Search, the movelists are
+ * on the stack, so nothing is allocated once the Board histories have grown
+ * to the game length plus the search depth.
+ * A Search is not thread safe, the TranspositionTable can be shared.
+ *******************/
+class Search
+{
+  public:
+    Search(TranspositionTable &table, Evaluate evaluate) : table(table), evaluate(evaluate)
+    {
+    }
+
+    /// @brief searches board until a limit is hit or stop() is called,
+    /// the board is back in its original position afterwards.
+    /// Call TranspositionTable::newSearch before every new search.
+    /// @param board
+    /// @param limits
+    /// @param onIteration called with a SearchInfo after every completed iteration
+    /// @param startDepth first iteration
+    /// @return best move of the last completed iteration, NO_MOVE without legal moves
+    template <typename Callback>
+    Move go(Board &board, const SearchLimits &limits, Callback &&onIteration, int startDepth = 1)
+    {
+        // a stop() from before this point belongs to the previous search,
+        // with shared numbers the owner has already started the search
+        searchId = ownsSequence ? sequence->fetch_add(1, std::memory_order_relaxed) + 1
+                                : sequence->load(std::memory_order_relaxed);
+        aborted = false;
+        nodes.store(0, std::memory_order_relaxed);
+        this->limits = limits;
+        start = std::chrono::steady_clock::now();
+
+        bestMove = NO_MOVE;
+        bestScore = 0;
+        completedDepth = 0;
+        bestPvLength = 0;
+
+        const int maxDepth = limits.depth > 0 ? std::min(limits.depth, MAX_PLY - 1) : MAX_PLY - 1;
+        uint64_t previousNodes = 0;
+
+        board.setPrefetch(TranspositionTable::prefetchHook, &table);
+
+        for (int depth = std::clamp(startDepth, 1, maxDepth); depth <= maxDepth; depth++)
+        {
+            const uint64_t iterationStart = nodeCount();
+            selDepth = 0;
+
+            const int score = search(board, -VALUE_INFINITE, VALUE_INFINITE, depth, 0, true);
+
+            if (aborted && completedDepth > 0)
+                break;
+
+            // an aborted first iteration still has the best move so far,
+            // its score is the one of the last root move that was searched completely
+            if (pvLength[0] > 0)
+            {
+                bestMove = pv[0][0];
+                bestScore = aborted ? rootScore : score;
+                bestPvLength = pvLength[0];
+                std::copy(pv[0], pv[0] + bestPvLength, bestPv);
+            }
+
+            if (aborted)
+                break;
+
+            completedDepth = depth;
+
+            SearchInfo info;
+            info.depth = depth;
+            info.selDepth = selDepth;
+            info.score = score;
+            info.nodes = nodeCount();
+            info.ms = elapsed();
+            info.branchingFactor =
+                previousNodes ? double(info.nodes - iterationStart) / double(previousNodes) : 0.0;
+            info.pv = bestPv;
+            info.pvLength = bestPvLength;
+            onIteration(static_cast<const SearchInfo &>(info));
+
+            previousNodes = info.nodes - iterationStart;
+
+            if (bestPvLength == 0 || std::abs(score) >= VALUE_MATE_IN_MAX_PLY)
+                break;
+        }
+
+        board.setPrefetch(nullptr, nullptr);
+
+        // stopped before the first root move was searched
+        if (bestMove == NO_MOVE)
+        {
+            Movelist moves;
+            Movegen::legalmoves<ALL>(board, moves);
+            if (moves.size)
+                bestMove = moves[0].move;
+        }
+
+        return bestMove;
+    }
+
+    Move go(Board &board, const SearchLimits &limits)
+    {
+        return go(board, limits, [](const SearchInfo &) {});
+    }
+
+    /// @brief ends the running search at the next node, safe to call from any thread.
+    /// Only applies to the search that is running or was started last,
+    /// a stop that comes after a search has finished does not touch the next one
+    void stop()
+    {
+        stopRequest->store(sequence->load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    /// @brief numbers the searches with counters of the caller, so one stop request
+    /// ends many Searches. go() then searches under the current number of sequence,
+    /// the caller starts a search by incrementing it
+    /// @param sharedSequence
+    /// @param sharedStopRequest
+    void shareStop(std::atomic<uint64_t> *sharedSequence, std::atomic<uint64_t> *sharedStopRequest)
+    {
+        sequence = sharedSequence;
+        stopRequest = sharedStopRequest;
+        ownsSequence = false;
+    }
+
+    /// @brief nodes of the current or last search, can be read from any thread
+    uint64_t nodeCount() const
+    {
+        return nodes.load(std::memory_order_relaxed);
+    }
+
+    /// @brief forgets the killers
+    void clear()
+    {
+        std::fill(&killers[0][0], &killers[0][0] + MAX_PLY * 2, NO_MOVE);
+    }
+
+    Move bestMove = NO_MOVE;
+    int bestScore = 0;
+    int completedDepth = 0;
+
+    const Move *principalVariation() const
+    {
+        return bestPv;
+    }
+
+    int principalVariationLength() const
+    {
+        return bestPvLength;
+    }
+
+  private:
+    TranspositionTable &table;
+    Evaluate evaluate;
+
+    SearchLimits limits;
+    std::chrono::steady_clock::time_point start;
+    // searches are numbered, stop() requests the end of the current number
+    std::atomic<uint64_t> ownSequence{0};
+    std::atomic<uint64_t> ownStopRequest{~uint64_t(0)};
+    std::atomic<uint64_t> *sequence = &ownSequence;
+    std::atomic<uint64_t> *stopRequest = &ownStopRequest;
+    bool ownsSequence = true;
+    uint64_t searchId = 0;
+
+    // set by the searching thread once the search has to end
+    bool aborted = false;
+
+    // score of the best root move of the current iteration so far
+    int rootScore = 0;
+
+    // only written by the searching thread, relaxed load and store instead of a locked add
+    std::atomic<uint64_t> nodes{0};
+    int selDepth = 0;
+
+    Move killers[MAX_PLY][2] = {};
+
+    // triangular PV table, pv[ply] is the line from ply on
+    Move pv[MAX_PLY + 1][MAX_PLY + 1] = {};
+    int pvLength[MAX_PLY + 1] = {};
+
+    Move bestPv[MAX_PLY + 1] = {};
+    int bestPvLength = 0;
+
+    int64_t elapsed() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)
+            .count();
+    }
+
+    /// @brief checks the limits, the clock only every 1024 nodes
+    bool shouldStop()
+    {
+        if (aborted)
+            return true;
+
+        const uint64_t n = nodeCount();
+        if (stopRequest->load(std::memory_order_relaxed) == searchId)
+            aborted = true;
+        else if (limits.nodes && n >= limits.nodes)
+            aborted = true;
+        else if (limits.timeMs && (n & 1023) == 0 && elapsed() >= limits.timeMs)
+            aborted = true;
+
+        return aborted;
+    }
+
+    void countNode()
+    {
+        nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /// @brief mate scores are stored as distance from the node, not from the root
+    static int scoreToTable(int score, int ply)
+    {
+        return score >= VALUE_MATE_IN_MAX_PLY ? score + ply : score <= -VALUE_MATE_IN_MAX_PLY ? score - ply : score;
+    }
+
+    static int scoreFromTable(int score, int ply)
+    {
+        return score >= VALUE_MATE_IN_MAX_PLY ? score - ply : score <= -VALUE_MATE_IN_MAX_PLY ? score + ply : score;
+    }
+
+    bool isCapture(const Board &board, Move move) const
+    {
+        const Square sq = to(move);
+        return (board.pieceAtB(sq) != None && board.colorOf(sq) != board.sideToMove) ||
+               (piece(move) == PAWN && !promoted(move) && sq == board.enPassantSquare);
+    }
+
+    int search(Board &board, int alpha, int beta, int depth, int ply, bool nullAllowed)
+    {
+        const bool pvNode = beta - alpha > 1;
+        pvLength[ply] = 0;
+
+        if (depth <= 0)
+            return quiescence(board, alpha, beta, ply);
+
+        countNode();
+        selDepth = std::max(selDepth, ply);
+
+        if (shouldStop())
+            return 0;
+
+        if (ply > 0)
+        {
+            if (board.halfMoveClock >= 100 || board.isRepetition(1))
+                return 0;
+
+            // mate distance pruning
+            alpha = std::max(alpha, -VALUE_MATE + ply);
+            beta = std::min(beta, VALUE_MATE - ply - 1);
+            if (alpha >= beta)
+                return alpha;
+        }
+
+        if (ply >= MAX_PLY - 1)
+            return evaluate(board);
+
+        TTData entry;
+        const bool hit = table.probe(board.hashKey, entry);
+        const Move hashMove = hit ? entry.move : NO_MOVE;
+
+        if (hit && !pvNode && entry.depth >= depth)
+        {
+            const int score = scoreFromTable(entry.score, ply);
+            if (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && score >= beta) ||
+                (entry.bound == BOUND_UPPER && score <= alpha))
+                return score;
+        }
+
+        const bool inCheck = board.in_check();
+
+        // null move pruning, not in pawn endings because of zugzwang
+        if (nullAllowed && !pvNode && !inCheck && depth >= 3 && board.nonPawnMat(board.sideToMove) &&
+            evaluate(board) >= beta)
+        {
+            const int reduction = 3 + depth / 6;
+
+            board.makeNullMove();
+            const int score = -search(board, -beta, -beta + 1, depth - 1 - reduction, ply + 1, false);
+            board.unmakeNullMove();
+
+            if (aborted)
+                return 0;
+            if (score >= beta)
+                return score >= VALUE_MATE_IN_MAX_PLY ? beta : score;
+        }
+
+        const int oldAlpha = alpha;
+        int bestScore = -VALUE_INFINITE;
+        Move best = NO_MOVE;
+        int played = 0;
+
+        Movegen::MovePicker picker(board, hashMove, killers[ply][0], killers[ply][1]);
+
+        for (Move move = picker.next(); move != NO_MOVE; move = picker.next())
+        {
+            const bool capture = isCapture(board, move);
+            played++;
+
+            board.makeMove(move);
+
+            const int extension = board.in_check() ? 1 : 0;
+            int score;
+
+            if (played == 1)
+            {
+                score = -search(board, -beta, -alpha, depth - 1 + extension, ply + 1, true);
+            }
+            else
+            {
+                score = -search(board, -alpha - 1, -alpha, depth - 1 + extension, ply + 1, true);
+                if (score > alpha && score < beta)
+                    score = -search(board, -beta, -alpha, depth - 1 + extension, ply + 1, true);
+            }
+
+            board.unmakeMove(move);
+
+            if (aborted)
+                return 0;
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = move;
+
+                if (score > alpha)
+                {
+                    alpha = score;
+
+                    pv[ply][0] = move;
+                    std::copy(pv[ply + 1], pv[ply + 1] + pvLength[ply + 1], pv[ply] + 1);
+                    pvLength[ply] = pvLength[ply + 1] + 1;
+
+                    if (ply == 0)
+                        rootScore = score;
+
+                    if (score >= beta)
+                    {
+                        if (!capture && !promoted(move) && killers[ply][0] != move)
+                        {
+                            killers[ply][1] = killers[ply][0];
+                            killers[ply][0] = move;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (played == 0)
+            return inCheck ? -VALUE_MATE + ply : 0;
+
+        const Bound bound = bestScore >= beta ? BOUND_LOWER : alpha > oldAlpha ? BOUND_EXACT : BOUND_UPPER;
+        table.store(board.hashKey, best, scoreToTable(bestScore, ply), depth, bound);
+
+        return bestScore;
+    }
+
+    /// @brief captures only, all evasions when in check
+    int quiescence(Board &board, int alpha, int beta, int ply)
+    {
+        countNode();
+        selDepth = std::max(selDepth, ply);
+
+        if (shouldStop())
+            return 0;
+
+        const bool inCheck = board.in_check();
+
+        if (ply >= MAX_PLY - 1)
+            return inCheck ? 0 : evaluate(board);
+
+        int bestScore = -VALUE_INFINITE;
+
+        if (!inCheck)
+        {
+            bestScore = evaluate(board);
+            if (bestScore >= beta)
+                return bestScore;
+            alpha = std::max(alpha, bestScore);
+        }
+
+        Movelist moves;
+        if (inCheck)
+            Movegen::legalmoves<ALL>(board, moves);
+        else
+            Movegen::legalmoves<CAPTURE>(board, moves);
+
+        if (inCheck && moves.size == 0)
+            return -VALUE_MATE + ply;
+
+        // MVV-LVA
+        static constexpr int VALUE[7] = {1, 3, 3, 5, 9, 0, 0};
+        for (auto &ext : moves)
+        {
+            const PieceType victim = board.pieceTypeAtB(to(ext.move));
+            ext.value = 16 * (victim == NONETYPE ? (isCapture(board, ext.move) ? 1 : 0) : VALUE[victim]) -
+                        VALUE[promoted(ext.move) ? PAWN : piece(ext.move)];
+            if (promoted(ext.move))
+                ext.value += 16 * VALUE[piece(ext.move)];
+        }
+
+        for (int i = 0; i < moves.size; i++)
+        {
+            int pick = i;
+            for (int j = i + 1; j < moves.size; j++)
+            {
+                if (moves[j] > moves[pick])
+                    pick = j;
+            }
+            std::swap(moves[i], moves[pick]);
+
+            const Move move = moves[i].move;
+
+            board.makeMove(move);
+            const int score = -quiescence(board, -beta, -alpha, ply + 1);
+            board.unmakeMove(move);
+
+            if (aborted)
+                return 0;
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                if (score > alpha)
+                {
+                    alpha = score;
+                    if (score >= beta)
+                        break;
+                }
+            }
+        }
+
+        return bestScore;
+    }
+};
+
+/********************
+ * Lazy SMP: n Searches on private copies of the Board that only share the
+ * TranspositionTable. Every other helper starts one ply deeper, so the
+ * threads are out of phase and fill the table for each other.
+ * The first thread enforces the limits and reports the iterations, with
+ * the nodes of all threads. Once it is done the helpers are stopped and
+ * the result of the thread with the deepest completed iteration is taken.
+ *******************/
+class LazySmp
+{
+  public:
+    LazySmp(TranspositionTable &table, int threads, Evaluate evaluate)
+    {
+        for (int i = 0; i < std::max(1, threads); i++)
+        {
+            searches.push_back(std::make_unique<Search>(table, evaluate));
+            searches.back()->shareStop(&sequence, &stopRequest);
+        }
+    }
+
+    /// @brief searches board on all threads, see Search::go
+    /// @param board
+    /// @param limits the node limit is for all threads together
+    /// @param onIteration called on the calling thread after every iteration of the first thread
+    /// @return best move of the deepest completed iteration
+    template <typename Callback> Move go(const Board &board, const SearchLimits &limits, Callback &&onIteration)
+    {
+        const int threads = int(searches.size());
+
+        // stop() requests from before this point belong to the previous search
+        const uint64_t id = sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        SearchLimits threadLimits = limits;
+        if (limits.nodes)
+            threadLimits.nodes = std::max<uint64_t>(1, limits.nodes / uint64_t(threads));
+
+        std::vector<Board> boards(threads, board);
+        std::vector<std::thread> helpers;
+
+        for (int i = 1; i < threads; i++)
+        {
+            helpers.emplace_back([this, &boards, &threadLimits, i]() {
+                searches[i]->go(boards[i], threadLimits, [](const SearchInfo &) {}, 1 + i % 2);
+            });
+        }
+
+        searches[0]->go(boards[0], threadLimits, [&](const SearchInfo &info) {
+            SearchInfo total = info;
+            total.nodes = nodeCount();
+            onIteration(static_cast<const SearchInfo &>(total));
+        });
+
+        stopRequest.store(id, std::memory_order_relaxed);
+        for (auto &helper : helpers)
+            helper.join();
+
+        best = 0;
+        for (int i = 1; i < threads; i++)
+        {
+            if (searches[i]->completedDepth > searches[best]->completedDepth &&
+                searches[i]->principalVariationLength() > 0)
+                best = i;
+        }
+
+        return searches[best]->bestMove;
+    }
+
+    Move go(const Board &board, const SearchLimits &limits)
+    {
+        return go(board, limits, [](const SearchInfo &) {});
+    }
+
+    /// @brief ends the running search on all threads, safe to call from any thread.
+    /// A stop that comes after a search has finished does not touch the next one
+    void stop()
+    {
+        stopRequest.store(sequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    /// @brief forgets the killers of all threads
+    void clear()
+    {
+        for (auto &search : searches)
+            search->clear();
+    }
+
+    /// @brief nodes of all threads
+    uint64_t nodeCount() const
+    {
+        uint64_t total = 0;
+        for (const auto &search : searches)
+            total += search->nodeCount();
+        return total;
+    }
+
+    /// @brief the thread whose result go returned
+    const Search &result() const
+    {
+        return *searches[best];
+    }
+
+    int threadCount() const
+    {
+        return int(searches.size());
+    }
+
+  private:
+    std::vector<std::unique_ptr<Search>> searches;
+    // shared by all Searches, see Search::shareStop
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<uint64_t> stopRequest{~uint64_t(0)};
+    int best = 0;
+};
+
+} // namespace Chess
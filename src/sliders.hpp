@@ -878,4 +878,132 @@ namespace Chess_Lookup::Fancy {
     static constexpr uint64_t QueenAttacks(int s, uint64_t occ) {
         return RookAttacks(s, occ) | BishopAttacks(s, occ);
     }
-}
\ No newline at end of file
+}
+
+#if defined(USE_PEXT) && defined(__BMI2__)
+#include <immintrin.h>
+
+//PEXT indexing, the relevant occupancy bits are gathered into a dense index.
+//No multiply and no shift, every square owns a table of exactly 2^popcount(mask) entries.
+//The tables are filled once at startup from the fancy magics above.
+namespace Chess_Lookup::Pext {
+
+    struct PextHash {
+        const uint64_t* attacks;
+        uint64_t mask;
+    };
+
+    struct PextTables {
+        uint64_t rook_table[102400];
+        uint64_t bishop_table[5248];
+        PextHash r_pext[64];
+        PextHash b_pext[64];
+
+        PextTables() {
+            uint64_t* r = rook_table;
+            uint64_t* b = bishop_table;
+            for (int s = 0; s < 64; s++) {
+                r = fill(r_pext[s], r, ~Fancy::r_magics[s].mask, s, Fancy::RookAttacks);
+                b = fill(b_pext[s], b, ~Fancy::b_magics[s].mask, s, Fancy::BishopAttacks);
+            }
+        }
+
+        //Walks all subsets of the mask (carry rippler) and stores the attacks at their pext index.
+        static uint64_t* fill(PextHash& m, uint64_t* table, uint64_t mask, int s, uint64_t (*attacks)(int, uint64_t)) {
+            m.attacks = table;
+            m.mask = mask;
+            uint64_t occ = 0;
+            do {
+                table[_pext_u64(occ, mask)] = attacks(s, occ);
+                occ = (occ - mask) & mask;
+            } while (occ);
+            return table + (1ull << __builtin_popcountll(mask));
+        }
+    };
+
+    inline const PextTables tables;
+
+    constexpr auto Size = sizeof(PextTables);
+
+    static inline uint64_t RookAttacks(int s, uint64_t occ) {
+        const PextHash& m = tables.r_pext[s];
+        return m.attacks[_pext_u64(occ, m.mask)];
+    }
+
+    static inline uint64_t BishopAttacks(int s, uint64_t occ) {
+        const PextHash& m = tables.b_pext[s];
+        return m.attacks[_pext_u64(occ, m.mask)];
+    }
+
+    static inline uint64_t QueenAttacks(int s, uint64_t occ) {
+        return RookAttacks(s, occ) | BishopAttacks(s, occ);
+    }
+}
+#endif
+
+
+//Obstruction difference, no lookup of attack sets at all.
+//Per square and line only the squares below and above the slider are stored (4 KB in total),
+//the attacks on a line are the squares between the nearest blocker below and the nearest blocker above.
+namespace Chess_Lookup::Obstruction {
+
+    struct LineMask {
+        uint64_t lower;
+        uint64_t upper;
+    };
+
+    //file, rank, diagonal and anti diagonal of every square
+    struct SquareMasks {
+        LineMask lines[4];
+    };
+
+    static constexpr uint64_t ray(int s, int df, int dr) {
+        uint64_t bb = 0;
+        int f = s % 8 + df, r = s / 8 + dr;
+        while (f >= 0 && f < 8 && r >= 0 && r < 8) {
+            bb |= 1ull << (r * 8 + f);
+            f += df;
+            r += dr;
+        }
+        return bb;
+    }
+
+    static constexpr std::array<SquareMasks, 64> make_masks() {
+        std::array<SquareMasks, 64> masks = {};
+        constexpr int dirs[4][2] = { { 0, 1 }, { 1, 0 }, { 1, 1 }, { -1, 1 } };
+        for (int s = 0; s < 64; s++) {
+            for (int l = 0; l < 4; l++) {
+                const uint64_t upper = ray(s, dirs[l][0], dirs[l][1]);
+                const uint64_t lower = ray(s, -dirs[l][0], -dirs[l][1]);
+                masks[s].lines[l] = { lower, upper };
+            }
+        }
+        return masks;
+    }
+
+    static constexpr std::array<SquareMasks, 64> masks = make_masks();
+
+    constexpr auto Size = sizeof(masks);
+
+    //The lowest blocker above the slider and everything from the highest blocker below it upwards.
+    //Subtracting the two leaves the squares in between, bit 0 stands in when there is no blocker below.
+    static constexpr uint64_t LineAttacks(const LineMask& m, uint64_t occ) {
+        const uint64_t lower = m.lower & occ;
+        const uint64_t upper = m.upper & occ;
+        const uint64_t ms1b = ~0ull << (63 - __builtin_clzll(lower | 1));
+        const uint64_t ls1b = upper & (0 - upper);
+        return (m.lower | m.upper) & (2 * ls1b + ms1b);
+    }
+
+    static constexpr uint64_t RookAttacks(int s, uint64_t occ) {
+        return LineAttacks(masks[s].lines[0], occ) | LineAttacks(masks[s].lines[1], occ);
+    }
+
+    static constexpr uint64_t BishopAttacks(int s, uint64_t occ) {
+        return LineAttacks(masks[s].lines[2], occ) | LineAttacks(masks[s].lines[3], occ);
+    }
+
+    static constexpr uint64_t QueenAttacks(int s, uint64_t occ) {
+        return RookAttacks(s, occ) | BishopAttacks(s, occ);
+    }
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "chess.hpp"
+
+namespace Chess
+{
+
+enum Bound : uint8_t
+{
+    BOUND_NONE,
+    BOUND_UPPER,
+    BOUND_LOWER,
+    BOUND_EXACT
+};
+
+/// @brief an entry as it is handed out by TranspositionTable::probe
+struct TTData
+{
+    Move move = NO_MOVE;
+    int16_t score = 0;
+    int depth = 0;
+    Bound bound = BOUND_NONE;
+};
+
+/********************
+ * Transposition table for searches, shared by any number of threads.
+ * Every entry is packed into one 64 bit atomic word:
+ * key 16 | move 16 | score 16 | depth 8 | bound 2 | generation 6
+ * so a probe never sees half of one store and half of another, a
+ * concurrent store at worst replaces the entry being read.
+ * Eight entries make up a bucket of one cache line, the bucket is picked
+ * with the high bits of the key and the entry is verified with its low 16 bits.
+ * Within a bucket an entry of the same key is updated, otherwise the entry
+ * with the lowest depth minus 8 times its age is replaced.
+ *******************/
+class TranspositionTable
+{
+  public:
+    // depths are stored with this offset, quiescence depths down to -DEPTH_OFFSET fit
+    static constexpr int DEPTH_OFFSET = 16;
+
+    explicit TranspositionTable(size_t mb = 16, int threads = 1)
+    {
+        resize(mb, threads);
+    }
+
+    ~TranspositionTable()
+    {
+        std::free(buckets);
+    }
+
+    TranspositionTable(const TranspositionTable &) = delete;
+    TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+    /// @brief reallocates the table and clears it on threads threads, not safe during a search.
+    /// Throws std::bad_alloc when the memory can not be allocated
+    /// @param mb
+    /// @param threads
+    void resize(size_t mb, int threads = 1)
+    {
+        const size_t newCount = std::max<size_t>(1, mb * 1024 * 1024 / sizeof(Bucket));
+
+        // 2 MB alignment lets the kernel back the table with huge pages
+        constexpr size_t alignment = 2 * 1024 * 1024;
+        const size_t bytes = (newCount * sizeof(Bucket) + alignment - 1) / alignment * alignment;
+        auto *allocated = static_cast<Bucket *>(std::aligned_alloc(alignment, bytes));
+
+        // the old table stays usable when there is not enough memory
+        if (!allocated)
+            throw std::bad_alloc();
+
+        std::free(buckets);
+        buckets = allocated;
+        count = newCount;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        madvise(buckets, bytes, MADV_HUGEPAGE);
+#endif
+
+        clear(threads);
+    }
+
+    /// @brief empties the table, every thread clears its own slice
+    /// @param threads
+    void clear(int threads = 1)
+    {
+        threads = std::max(1, threads);
+        std::vector<std::thread> workers;
+
+        for (int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([this, t, threads]() {
+                const size_t begin = count * t / threads;
+                const size_t end = count * (t + 1) / threads;
+                std::memset(static_cast<void *>(buckets + begin), 0, (end - begin) * sizeof(Bucket));
+            });
+        }
+
+        for (auto &worker : workers)
+            worker.join();
+
+        generation = 0;
+    }
+
+    /// @brief ages all entries, call once per search
+    void newSearch()
+    {
+        generation = (generation + 1) & 63;
+    }
+
+    /// @brief loads the bucket of key into the cache,
+    /// call it as soon as the key of the child position is known
+    /// @param key
+    void prefetch(U64 key) const
+    {
+        __builtin_prefetch(&buckets[index(key)]);
+    }
+
+    /// @brief Board prefetch hook, see Board::setPrefetch
+    /// @param table the TranspositionTable
+    /// @param key
+    static void prefetchHook(const void *table, U64 key)
+    {
+        static_cast<const TranspositionTable *>(table)->prefetch(key);
+    }
+
+    /// @brief looks up key
+    /// @param key
+    /// @param data only written on a hit
+    /// @return true on a hit
+    bool probe(U64 key, TTData &data) const
+    {
+        const Bucket &bucket = buckets[index(key)];
+        const uint16_t check = uint16_t(key);
+
+        for (const auto &entry : bucket.entries)
+        {
+            const uint64_t word = entry.load(std::memory_order_relaxed);
+            if (uint16_t(word) != check || boundOf(word) == BOUND_NONE)
+                continue;
+
+            data.move = Move(uint16_t(word >> 16));
+            data.score = int16_t(uint16_t(word >> 32));
+            data.depth = int(uint8_t(word >> 48)) - DEPTH_OFFSET;
+            data.bound = boundOf(word);
+            return true;
+        }
+
+        return false;
+    }
+
+    /// @brief stores a search result
+    /// @param key
+    /// @param move NO_MOVE keeps the move of an entry with the same key
+    /// @param score
+    /// @param depth
+    /// @param bound
+    void store(U64 key, Move move, int score, int depth, Bound bound)
+    {
+        Bucket &bucket = buckets[index(key)];
+        const uint16_t check = uint16_t(key);
+
+        std::atomic<uint64_t> *replace = &bucket.entries[0];
+        int worst = 1 << 20;
+
+        for (auto &entry : bucket.entries)
+        {
+            const uint64_t word = entry.load(std::memory_order_relaxed);
+
+            if (boundOf(word) == BOUND_NONE)
+            {
+                replace = &entry;
+                break;
+            }
+
+            if (uint16_t(word) == check)
+            {
+                // a deeper result of the current search is kept unless the new one is exact
+                const int oldDepth = int(uint8_t(word >> 48)) - DEPTH_OFFSET;
+                if (bound != BOUND_EXACT && depth < oldDepth - 3 && age(word) == 0)
+                    return;
+                if (move == NO_MOVE)
+                    move = Move(uint16_t(word >> 16));
+
+                replace = &entry;
+                break;
+            }
+
+            const int worth = int(uint8_t(word >> 48)) - 8 * age(word);
+            if (worth < worst)
+            {
+                worst = worth;
+                replace = &entry;
+            }
+        }
+
+        replace->store(pack(check, move, score, depth, bound), std::memory_order_relaxed);
+    }
+
+    /// @brief permille of the sampled entries that were written in the current search
+    int hashfull() const
+    {
+        const size_t samples = std::min<size_t>(count, 1000);
+        int used = 0;
+
+        for (size_t i = 0; i < samples; i++)
+        {
+            for (const auto &entry : buckets[i].entries)
+            {
+                const uint64_t word = entry.load(std::memory_order_relaxed);
+                used += boundOf(word) != BOUND_NONE && age(word) == 0;
+            }
+        }
+
+        return int(used * 1000 / (samples * ENTRIES));
+    }
+
+    size_t sizeMb() const
+    {
+        return count * sizeof(Bucket) / (1024 * 1024);
+    }
+
+  private:
+    static constexpr int ENTRIES = 8;
+
+    struct alignas(64) Bucket
+    {
+        std::atomic<uint64_t> entries[ENTRIES];
+    };
+
+    static_assert(sizeof(Bucket) == 64, "a bucket has to fill one cache line");
+
+    Bucket *buckets = nullptr;
+    size_t count = 0;
+    uint8_t generation = 0;
+
+    size_t index(U64 key) const
+    {
+        return size_t((unsigned __int128)key * count >> 64);
+    }
+
+    static Bound boundOf(uint64_t word)
+    {
+        return Bound((word >> 56) & 3);
+    }
+
+    /// @brief searches since the entry was written
+    int age(uint64_t word) const
+    {
+        return (generation - int(word >> 58)) & 63;
+    }
+
+    uint64_t pack(uint16_t check, Move move, int score, int depth, Bound bound) const
+    {
+        return uint64_t(check) | uint64_t(uint16_t(move)) << 16 | uint64_t(uint16_t(int16_t(score))) << 32 |
+               uint64_t(uint8_t(std::clamp(depth + DEPTH_OFFSET, 0, 255))) << 48 | uint64_t(bound) << 56 |
+               uint64_t(generation) << 58;
+    }
+};
+
+} // namespace Chess